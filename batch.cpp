@@ -0,0 +1,538 @@
+// Пакетная конвертация DXF/DWG файлов в эскизы без графического интерфейса
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "counters.h"
+#include "dx_handler.h"
+#include "ls_iface.h"
+#include "memory_stats.h"
+#include "parallel.h"
+#include "timing.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Settings {
+    std::vector<fs::path> inputs;
+    fs::path output_dir;            // Пустой путь - рядом с исходным файлом
+    fs::path summary_file;          // Пустой путь - только в стандартный вывод
+    fs::path timings_file;          // Время этапов обработки файлов в формате JSON. Пустой путь - без записи
+    fs::path trace_file;            // Этапы на шкале времени в формате Chrome trace. Пустой путь - без записи
+    fs::path counters_file;         // Счетчики геометрических проверок в формате CSV. Пустой путь - без записи
+    double offset = ls::Interface::DefaultOffset;
+    double segment_len = ls::Interface::DefaultSegLen;
+    double labels_height = 0.;      // Ноль - без номеров слоев
+    bool with_profile = false;      // Профиль толщины: CSV рядом с результатом и таблица в эскизе
+    double time_limit = 0.;         // Ограничение времени конвертации одного файла, с. Ноль - без ограничения
+    DRW::Version version = DRW::AC1027;
+    bool is_binary = false;
+    size_t jobs = domain::DefaultThreadsCount();
+};
+
+enum class Status {
+    Ok,
+    ImportFailed,
+    InvalidContent,
+    Partial,
+    ExportFailed,
+    Error
+};
+
+struct FileReport {
+    fs::path input;
+    fs::path output;
+    Status status = Status::Ok;
+    double seconds = 0.;
+    double width = 0.;
+    double height = 0.;
+    domain::CleanupReport cleanup;
+    ls::ConversionReport conversion;
+    std::vector<domain::StageTime> timings;
+    domain::CounterValues counters{};
+    domain::MemoryUsage memory;     // Заполняется в сборке с учетом памяти
+};
+
+std::string_view StatusName(Status status) {
+    switch (status) {
+    case Status::Ok: return "ok";
+    case Status::ImportFailed: return "import failed";
+    case Status::InvalidContent: return "invalid content";
+    case Status::Partial: return "partial";
+    case Status::ExportFailed: return "export failed";
+    case Status::Error: return "error";
+    }
+    return "unknown";
+}
+
+void PrintUsage(std::ostream& out) {
+    out << "Usage: LaminateSketchBatch [options] <file.dxf|file.dwg|directory>...\n"
+           "Options:\n"
+           "  -o, --output-dir <dir>   directory for result files (default: next to input)\n"
+           "      --offset <value>     distance between layers (default: "
+        << ls::Interface::DefaultOffset << ")\n"
+           "      --length <value>     max segment length (default: "
+        << ls::Interface::DefaultSegLen << ")\n"
+           "      --labels <height>    add ply number labels with the given text height\n"
+           "      --profile            write the thickness profile as CSV and add its table\n"
+           "      --time-limit <sec>   limit the conversion time per file; on timeout\n"
+           "                           the upper plies are written and the file is reported partial\n"
+           "      --version <ver>      AC1027, AC1024, AC1021, AC1018 or AC1015 (default: AC1027)\n"
+           "      --binary             write binary DXF\n"
+           "  -j, --jobs <count>       number of worker threads (default: hardware threads)\n"
+           "      --summary <file>     also write the summary as CSV\n"
+           "      --timings <file>     write the time of every processing stage as JSON,\n"
+           "                           including each round of ply extraction; a build with\n"
+           "                           LAMINATESKETCH_MEMORY_STATS adds allocations and memory,\n"
+           "                           attributed to single files only with -j 1\n"
+           "      --trace <file>       write every stage of every file on a timeline as\n"
+           "                           Chrome trace event JSON (Perfetto, chrome://tracing)\n"
+           "      --counters <file>    write the geometry predicate counts per file as CSV\n"
+           "                           (requires a build with LAMINATESKETCH_COUNTERS)\n"
+           "  -h, --help               show this help\n";
+}
+
+std::optional<DRW::Version> ParseVersion(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(), ::toupper);
+
+    if (value == "AC1027") return DRW::AC1027;
+    if (value == "AC1024") return DRW::AC1024;
+    if (value == "AC1021") return DRW::AC1021;
+    if (value == "AC1018") return DRW::AC1018;
+    if (value == "AC1015") return DRW::AC1015;
+    return std::nullopt;
+}
+
+bool IsSketchSource(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".dxf" || ext == ".dwg";
+}
+
+// Разбирает аргументы командной строки. При ошибке возвращает std::nullopt
+std::optional<Settings> ParseArguments(int argc, char* argv[]) {
+    Settings settings;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+
+        auto next_value = [&]() -> std::optional<std::string> {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return std::nullopt;
+            }
+            return std::string(argv[++i]);
+        };
+
+        try {
+            if (arg == "-h" || arg == "--help") {
+                PrintUsage(std::cout);
+                std::exit(EXIT_SUCCESS);
+            }
+            else if (arg == "-o" || arg == "--output-dir") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.output_dir = *value;
+            }
+            else if (arg == "--offset") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.offset = std::stod(*value);
+            }
+            else if (arg == "--length") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.segment_len = std::stod(*value);
+            }
+            else if (arg == "--labels") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.labels_height = std::stod(*value);
+            }
+            else if (arg == "--profile") {
+                settings.with_profile = true;
+            }
+            else if (arg == "--time-limit") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.time_limit = std::stod(*value);
+            }
+            else if (arg == "--version") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                auto version = ParseVersion(*value);
+                if (!version) {
+                    std::cerr << "Unsupported DXF version: " << *value << std::endl;
+                    return std::nullopt;
+                }
+                settings.version = *version;
+            }
+            else if (arg == "--binary") {
+                settings.is_binary = true;
+            }
+            else if (arg == "-j" || arg == "--jobs") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.jobs = std::max(1, std::stoi(*value));
+            }
+            else if (arg == "--summary") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.summary_file = *value;
+            }
+            else if (arg == "--timings") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.timings_file = *value;
+            }
+            else if (arg == "--trace") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.trace_file = *value;
+            }
+            else if (arg == "--counters") {
+                auto value = next_value();
+                if (!value) return std::nullopt;
+                settings.counters_file = *value;
+            }
+            else if (arg.starts_with("-")) {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return std::nullopt;
+            }
+            else {
+                settings.inputs.emplace_back(arg);
+            }
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return std::nullopt;
+        }
+    }
+
+    if (settings.inputs.empty()) {
+        std::cerr << "No input files" << std::endl;
+        return std::nullopt;
+    }
+    if (settings.offset <= 0. || settings.segment_len <= 0.) {
+        std::cerr << "Offset and segment length must be positive" << std::endl;
+        return std::nullopt;
+    }
+    if (settings.time_limit < 0.) {
+        std::cerr << "Time limit must not be negative" << std::endl;
+        return std::nullopt;
+    }
+    if (settings.labels_height < 0.) {
+        std::cerr << "Labels height must not be negative" << std::endl;
+        return std::nullopt;
+    }
+    if (!settings.counters_file.empty() && !domain::CountersEnabled) {
+        std::cerr << "Counters are not available: rebuild with -DLAMINATESKETCH_COUNTERS=ON" << std::endl;
+        return std::nullopt;
+    }
+    return settings;
+}
+
+// Раскрывает директории в список исходных файлов
+std::vector<fs::path> CollectFiles(const std::vector<fs::path>& inputs) {
+    std::vector<fs::path> result;
+
+    for (const auto& input : inputs) {
+        std::error_code ec;
+        if (fs::is_directory(input, ec)) {
+            std::vector<fs::path> files;
+            for (const auto& entry : fs::directory_iterator(input, ec)) {
+                if (entry.is_regular_file() && IsSketchSource(entry.path())) {
+                    files.push_back(entry.path());
+                }
+            }
+            std::sort(files.begin(), files.end());
+            result.insert(result.end(), files.begin(), files.end());
+        }
+        else {
+            result.push_back(input);
+        }
+    }
+    return result;
+}
+
+fs::path OutputPath(const fs::path& input, const Settings& settings) {
+    const fs::path dir = settings.output_dir.empty() ? input.parent_path() : settings.output_dir;
+    return dir / (input.stem().string() + "_sketch.dxf");
+}
+
+fs::path ProfilePath(const fs::path& output) {
+    return output.parent_path() / (output.stem().string() + "_profile.csv");
+}
+
+// Высота текста таблицы профиля толщины
+constexpr double ProfileTextHeight = 3.5;
+
+FileReport ConvertFile(const fs::path& input, const Settings& settings, domain::TraceRecorder& trace) {
+    const auto start = std::chrono::steady_clock::now();
+    domain::MemoryWindow memory;
+
+    FileReport report{ .input = input, .output = OutputPath(input, settings) };
+
+    // Этапы записываются в отчет файла, включая этапы параллельных задач его конвертации
+    domain::TimingReport timings;
+    const domain::TimingScope timing_scope(settings.timings_file.empty() ? nullptr : &timings, &trace);
+    domain::CounterSet counters;
+
+    const auto convert = [&] {
+        dx::Handler handler;
+        if (!handler.importFile(input.string())) {
+            report.status = Status::ImportFailed;
+            return;
+        }
+
+        std::optional<std::chrono::milliseconds> budget;
+        if (settings.time_limit > 0.) {
+            budget = std::chrono::milliseconds(static_cast<long long>(settings.time_limit * 1000.));
+        }
+        auto converted = ls::Interface::convertSketch(handler.getRawSketch(),
+                                                      domain::Progress(std::stop_token{}, budget)).value();
+        report.conversion = converted.report;
+
+        ls::Interface sketch;
+        if (!sketch.setConverted(std::move(converted))) {
+            report.status = Status::InvalidContent;
+            return;
+        }
+        report.cleanup = sketch.cleanupReport();
+        sketch.optimizeSketch(settings.offset, settings.segment_len);
+        report.width = sketch.width();
+        report.height = sketch.height();
+
+        handler.putRawSketch(sketch.rawSketch());
+        handler.putCores(sketch.cores());
+        if (settings.labels_height > 0.) {
+            handler.putPlyLabels(sketch.plyLabels(settings.labels_height));
+        }
+        if (settings.with_profile) {
+            // Таблица справа от эскиза, верхний край на уровне верха эскиза
+            handler.putThicknessTable(sketch.thicknessProfile(),
+                                      { sketch.width() + 10. * ProfileTextHeight, sketch.height() },
+                                      ProfileTextHeight);
+            std::ofstream csv(ProfilePath(report.output));
+            domain::WriteProfileCsv(sketch.thicknessProfile(), csv);
+            if (!csv) {
+                report.status = Status::ExportFailed;
+                return;
+            }
+        }
+        if (!handler.exportFile(report.output.string(), settings.version, settings.is_binary)) {
+            report.status = Status::ExportFailed;
+        }
+        else if (report.conversion.isPartial()) {
+            report.status = Status::Partial;
+        }
+    };
+
+    // Ошибка в одном файле не должна прерывать обработку остальных
+    try {
+        // Счетчики потоков добавляются в итог файла при завершении области подсчета
+        const domain::CounterScope counter_scope(&counters);
+        convert();
+    }
+    catch (const std::exception& e) {
+        report.status = Status::Error;
+        std::cerr << input.string() << ": " << e.what() << std::endl;
+    }
+
+    const auto finish = std::chrono::steady_clock::now();
+    report.seconds = std::chrono::duration<double>(finish - start).count();
+    trace.record(input.filename().string(), start, finish);
+    report.memory = memory.finish();
+    report.timings = timings.stages();
+    report.counters = counters.values();
+    return report;
+}
+
+double ToMegabytes(std::uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024. * 1024.);
+}
+
+void PrintSummary(const std::vector<FileReport>& reports, double total_seconds, std::ostream& out) {
+    size_t failed = 0;
+
+    out << std::fixed << std::setprecision(3);
+    for (const auto& report : reports) {
+        if (report.status != Status::Ok) {
+            ++failed;
+        }
+        out << std::setw(10) << report.seconds << " s  "
+            << std::setw(16) << std::left << StatusName(report.status) << std::right
+            << report.input.string();
+        if (!report.cleanup.isEmpty()) {
+            out << " (welded " << report.cleanup.welded_endpoints
+                << ", joined " << report.cleanup.joined_polylines
+                << ", duplicates " << report.cleanup.removed_duplicates << ')';
+        }
+        if (domain::MemoryStatsAvailable()) {
+            out << " [peak " << std::setprecision(1) << ToMegabytes(report.memory.peak_bytes) << " MB, "
+                << report.memory.allocations << " allocations]" << std::setprecision(3);
+        }
+        out << '\n';
+
+        // Для частично преобразованных и непреобразованных файлов - самые затратные ломаные
+        const auto& conversion = report.conversion;
+        if (conversion.isPartial()) {
+            out << std::setw(16) << ' ' << "converted " << conversion.total_polylines - conversion.remaining_polylines
+                << " of " << conversion.total_polylines << " polylines"
+                << (conversion.status == ls::ConversionStatus::TimedOut ? ", time limit exceeded" : "") << '\n';
+            for (const auto& cost : conversion.expensive) {
+                out << std::setw(16) << ' ' << std::setprecision(1) << cost.seconds * 1000. << " ms  "
+                    << cost.points_count << " points (" << std::setprecision(2)
+                    << cost.first.x << ", " << cost.first.y << ") - (" << cost.last.x << ", " << cost.last.y << ")\n";
+            }
+            out << std::setprecision(3);
+        }
+    }
+    out << "Files: " << reports.size() << ", failed: " << failed
+        << ", total time: " << total_seconds << " s";
+    if (domain::MemoryStatsAvailable()) {
+        // Пик процесса определяет память, необходимую при заданном числе потоков
+        out << ", peak memory: " << std::setprecision(1)
+            << ToMegabytes(domain::ReadMemoryStats().peak_bytes) << " MB" << std::setprecision(3);
+    }
+    out << std::endl;
+}
+
+void WriteCsvSummary(const std::vector<FileReport>& reports, std::ostream& out) {
+    out << "input,output,status,seconds,width,height,welded,joined,duplicates,polylines,remaining\n";
+    out << std::setprecision(6);
+    for (const auto& report : reports) {
+        out << '"' << report.input.string() << "\",\"" << report.output.string() << "\","
+            << StatusName(report.status) << ',' << report.seconds << ','
+            << report.width << ',' << report.height << ','
+            << report.cleanup.welded_endpoints << ',' << report.cleanup.joined_polylines << ','
+            << report.cleanup.removed_duplicates << ','
+            << report.conversion.total_polylines << ',' << report.conversion.remaining_polylines << '\n';
+    }
+}
+
+void WriteCountersCsv(const std::vector<FileReport>& reports, std::ostream& out) {
+    out << "input,status";
+    for (size_t i = 0; i < domain::CountersCount; ++i) {
+        out << ',' << domain::CounterName(static_cast<domain::Counter>(i));
+    }
+    out << '\n';
+    for (const auto& report : reports) {
+        out << '"' << report.input.string() << "\"," << StatusName(report.status);
+        for (const auto value : report.counters) {
+            out << ',' << value;
+        }
+        out << '\n';
+    }
+}
+
+void WriteTimingsJson(const std::vector<FileReport>& reports, std::ostream& out) {
+    out << "{\n  \"files\": [\n" << std::setprecision(6);
+    for (size_t i = 0; i < reports.size(); ++i) {
+        const auto& report = reports[i];
+        out << "    {\"input\": ";
+        domain::WriteJsonString(report.input.string(), out);
+        out << ", \"status\": ";
+        domain::WriteJsonString(StatusName(report.status), out);
+        out << ", \"seconds\": " << report.seconds;
+        if (domain::MemoryStatsAvailable()) {
+            out << ", ";
+            domain::WriteMemoryUsageJson(report.memory, out);
+        }
+        out << ",\n     \"stages\": ";
+        domain::WriteTimingsJson(report.timings, out);
+        out << '}' << (i + 1 < reports.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const auto settings = ParseArguments(argc, argv);
+    if (!settings) {
+        PrintUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    if (!settings->output_dir.empty()) {
+        std::error_code ec;
+        fs::create_directories(settings->output_dir, ec);
+        if (ec) {
+            std::cerr << "Cannot create output directory " << settings->output_dir << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto files = CollectFiles(settings->inputs);
+    std::vector<FileReport> reports(files.size());
+
+    // Без файла записи трассировка не включается, и этапы в нее не записываются
+    domain::TraceRecorder trace;
+    if (!settings->trace_file.empty()) {
+        trace.setThreadName("main");
+        trace.start();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    domain::ParallelFor(files.size(), [&](size_t index) {
+        reports[index] = ConvertFile(files[index], *settings, trace);
+    }, settings->jobs);
+    trace.stop();
+    const double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    PrintSummary(reports, total_seconds, std::cout);
+
+    if (!settings->summary_file.empty()) {
+        std::ofstream summary(settings->summary_file);
+        if (!summary) {
+            std::cerr << "Cannot write summary to " << settings->summary_file << std::endl;
+            return EXIT_FAILURE;
+        }
+        WriteCsvSummary(reports, summary);
+    }
+
+    if (!settings->counters_file.empty()) {
+        std::ofstream counters(settings->counters_file);
+        WriteCountersCsv(reports, counters);
+        if (!counters) {
+            std::cerr << "Cannot write counters to " << settings->counters_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!settings->trace_file.empty()) {
+        std::ofstream out(settings->trace_file);
+        trace.writeChromeTrace(out);
+        if (!out) {
+            std::cerr << "Cannot write trace to " << settings->trace_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!settings->timings_file.empty()) {
+        std::ofstream timings(settings->timings_file);
+        WriteTimingsJson(reports, timings);
+        if (!timings) {
+            std::cerr << "Cannot write timings to " << settings->timings_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const bool all_ok = std::all_of(reports.begin(), reports.end(),
+                                    [](const auto& report) { return report.status == Status::Ok; });
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
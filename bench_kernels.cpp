@@ -0,0 +1,438 @@
+// Микробенчмарки геометрических функций common.cpp на синтетических данных с фиксированным зерном
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.h"
+
+namespace {
+
+using namespace domain;
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+    unsigned seed = 42;
+    double min_time = 0.5;          // Минимальное время одного замера, с
+    size_t repetitions = 5;         // Число замеров, в отчет идет медиана
+    std::string filter;             // Подстрока имени бенчмарка, пустая - все
+    std::string json_file;          // Пустой путь - без сохранения результатов
+    std::string baseline_file;      // Результаты прежнего запуска для сравнения
+};
+
+// Бенчмарк: 'run' выполняет 'ops' операций и возвращает контрольное значение,
+// не позволяющее компилятору удалить вычисления
+struct Benchmark {
+    std::string name;
+    double items_per_op = 1.;       // Обрабатываемых элементов (точек, ребер) на операцию
+    std::function<std::uint64_t(size_t ops)> run;
+};
+
+struct Result {
+    std::string name;
+    size_t iterations = 0;
+    double ns_per_op = 0.;
+    double ops_per_sec = 0.;
+    double items_per_sec = 0.;
+};
+
+// ---- Синтетические данные ----
+
+// Случайные отрезки в квадрате 100 x 100 мм
+std::vector<std::pair<Point, Point>> MakeRandomSegments(std::mt19937& rng, size_t count) {
+    std::uniform_real_distribution<double> coord(0., 100.);
+    std::vector<std::pair<Point, Point>> result(count);
+    for (auto& [a, b] : result) {
+        a = { coord(rng), coord(rng) };
+        b = { coord(rng), coord(rng) };
+    }
+    return result;
+}
+
+// Пары почти параллельных отрезков соседних слоев: толщина слоя 0.25 мм, разница наклонов до 1e-4
+std::vector<std::pair<Point, Point>> MakeNearlyParallelSegments(std::mt19937& rng, size_t count) {
+    std::uniform_real_distribution<double> x(0., 300.);
+    std::uniform_real_distribution<double> length(1., 10.);
+    std::uniform_real_distribution<double> slope(-0.1, 0.1);
+    std::uniform_real_distribution<double> deviation(-1e-4, 1e-4);
+    std::vector<std::pair<Point, Point>> result(count);
+    for (size_t i = 0; i + 1 < count; i += 2) {
+        const double x0 = x(rng);
+        const double len = length(rng);
+        const double k = slope(rng);
+        result[i] = { { x0, 0. }, { x0 + len, k * len } };
+        result[i + 1] = { { x0, 0.25 }, { x0 + len, 0.25 + (k + deviation(rng)) * len } };
+    }
+    return result;
+}
+
+// Многоугольник из 'count' вершин: окружность радиуса 50 мм с шумом радиуса
+Polygon MakeLargePolygon(std::mt19937& rng, size_t count) {
+    std::uniform_real_distribution<double> noise(-5., 5.);
+    Polygon result;
+    for (size_t i = 0; i < count; ++i) {
+        const double angle = 2. * std::numbers::pi * static_cast<double>(i) / static_cast<double>(count);
+        const double radius = 50. + noise(rng);
+        result.addPoint({ radius * std::cos(angle), radius * std::sin(angle) });
+    }
+    return result;
+}
+
+// Линия слоя с частыми выбросами: шаг 1 мм, каждая пятая точка смещена на 2-5 мм.
+// Смещение такой линии дает самопересечения
+Polyline MakeSpikyPolyline(std::mt19937& rng, size_t count) {
+    std::uniform_real_distribution<double> spike(2., 5.);
+    std::uniform_real_distribution<double> noise(-0.05, 0.05);
+    Polyline result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const double y = (i % 5 == 2) ? spike(rng) : noise(rng);
+        result.push_back({ static_cast<double>(i), y });
+    }
+    return result;
+}
+
+// Плавная линия слоя со сбросом: шаг 0.5 мм
+Polyline MakeSmoothPly(size_t count) {
+    Polyline result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const double x = 0.5 * static_cast<double>(i);
+        result.push_back({ x, 2. * std::tanh((x - 0.25 * static_cast<double>(count)) / 10.) });
+    }
+    return result;
+}
+
+// Линия слоя с избыточными точками: на каждом прямом участке 20 точек с отклонением до 1e-9 мм
+RawPolyline MakeDenseCollinearPly(std::mt19937& rng, size_t count) {
+    std::uniform_real_distribution<double> noise(-1e-9, 1e-9);
+    RawPolyline result;
+    result.reserve(count);
+    double y = 0.;
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 20 == 0) {
+            y += 0.25;      // Излом каждые 20 точек
+        }
+        const double x = static_cast<double>(i);
+        result.append({ x, y + 0.01 * x + noise(rng) });
+    }
+    return result;
+}
+
+// ---- Бенчмарки ----
+
+std::uint64_t Checksum(const std::optional<Point>& point) {
+    return point.has_value() ? 1 : 0;
+}
+
+std::vector<Benchmark> MakeBenchmarks(unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<Benchmark> result;
+
+    auto random_segments = std::make_shared<std::vector<std::pair<Point, Point>>>(MakeRandomSegments(rng, 4096));
+    result.push_back({ "FindSegmentsIntersection/random_segments", 1., [random_segments](size_t ops) {
+        const auto& segments = *random_segments;
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            const auto& [a, b] = segments[(2 * i) % segments.size()];
+            const auto& [c, d] = segments[(2 * i + 1) % segments.size()];
+            sum += Checksum(FindSegmentsIntersection(a, b, c, d));
+        }
+        return sum;
+    } });
+
+    auto parallel_segments = std::make_shared<std::vector<std::pair<Point, Point>>>(MakeNearlyParallelSegments(rng, 4096));
+    result.push_back({ "FindSegmentsIntersection/nearly_parallel_plies", 1., [parallel_segments](size_t ops) {
+        const auto& segments = *parallel_segments;
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            const auto& [a, b] = segments[(2 * i) % segments.size()];
+            const auto& [c, d] = segments[(2 * i + 1) % segments.size()];
+            sum += Checksum(FindSegmentsIntersection(a, b, c, d));
+        }
+        return sum;
+    } });
+
+    for (const size_t vertices : { 64, 10000 }) {
+        auto polygon = std::make_shared<Polygon>(MakeLargePolygon(rng, vertices));
+        std::uniform_real_distribution<double> coord(-60., 60.);
+        auto points = std::make_shared<std::vector<Point>>(1024);
+        for (auto& point : *points) {
+            point = { coord(rng), coord(rng) };
+        }
+        result.push_back({ "IsPointInPolygon/polygon_" + std::to_string(vertices), static_cast<double>(vertices),
+                           [polygon, points](size_t ops) {
+            std::uint64_t sum = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                sum += IsPointInPolygon((*points)[i % points->size()], *polygon) ? 1 : 0;
+            }
+            return sum;
+        } });
+    }
+
+    auto spiky = std::make_shared<Polyline>(MakeSpikyPolyline(rng, 1000));
+    result.push_back({ "OffsetPolyline/spiky_curve", static_cast<double>(spiky->size()), [spiky](size_t ops) {
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            sum += OffsetPolyline(*spiky, 0.5).size();
+        }
+        return sum;
+    } });
+
+    auto smooth = std::make_shared<Polyline>(MakeSmoothPly(1000));
+    result.push_back({ "OffsetPolyline/smooth_ply", static_cast<double>(smooth->size()), [smooth](size_t ops) {
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            sum += OffsetPolyline(*smooth, 0.5).size();
+        }
+        return sum;
+    } });
+
+    // Время удаления самопересечений квадратично по числу точек, поэтому линия короче
+    auto offset_spiky = std::make_shared<Polyline>(OffsetPolyline(MakeSpikyPolyline(rng, 200), 0.5));
+    result.push_back({ "RemoveSelfIntersections/spiky_offset", static_cast<double>(offset_spiky->size()),
+                       [offset_spiky](size_t ops) {
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            sum += RemoveSelfIntersections(*offset_spiky).size();
+        }
+        return sum;
+    } });
+
+    auto short_smooth = std::make_shared<Polyline>(MakeSmoothPly(200));
+    result.push_back({ "RemoveSelfIntersections/smooth_ply", static_cast<double>(short_smooth->size()),
+                       [short_smooth](size_t ops) {
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            sum += RemoveSelfIntersections(*short_smooth).size();
+        }
+        return sum;
+    } });
+
+    auto dense = std::make_shared<RawPolyline>(MakeDenseCollinearPly(rng, 10000));
+    result.push_back({ "RemoveExtraDots/dense_collinear_ply", static_cast<double>(dense->pointsCount()),
+                       [dense](size_t ops) {
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            sum += RemoveExtraDots(*dense, 1e-3).pointsCount();
+        }
+        return sum;
+    } });
+
+    return result;
+}
+
+// ---- Замер ----
+
+double Seconds(Clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+// Подбирает число операций, выполняемых не быстрее 'min_time', и возвращает медиану замеров
+Result Measure(const Benchmark& benchmark, const Settings& settings, std::uint64_t& sink) {
+    size_t ops = 1;
+    while (true) {
+        const auto start = Clock::now();
+        sink += benchmark.run(ops);
+        const double elapsed = Seconds(Clock::now() - start);
+        if (elapsed >= settings.min_time / 10. || ops >= (size_t(1) << 40)) {
+            // Пробный запуск занимает десятую часть замера
+            ops = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(ops) * settings.min_time
+                                                          / std::max(elapsed, 1e-9)));
+            break;
+        }
+        ops *= 10;
+    }
+
+    std::vector<double> ns_per_op;
+    for (size_t i = 0; i < settings.repetitions; ++i) {
+        const auto start = Clock::now();
+        sink += benchmark.run(ops);
+        ns_per_op.push_back(Seconds(Clock::now() - start) * 1e9 / static_cast<double>(ops));
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    const double median = ns_per_op[ns_per_op.size() / 2];
+
+    return Result{
+        .name = benchmark.name,
+        .iterations = ops,
+        .ns_per_op = median,
+        .ops_per_sec = 1e9 / median,
+        .items_per_sec = 1e9 / median * benchmark.items_per_op
+    };
+}
+
+// ---- Результаты ----
+
+void WriteJson(const std::vector<Result>& results, const Settings& settings, std::ostream& out) {
+    out << std::setprecision(6);
+    out << "{\n  \"seed\": " << settings.seed << ",\n  \"min_time\": " << settings.min_time
+        << ",\n  \"repetitions\": " << settings.repetitions << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+            << ", \"ns_per_op\": " << result.ns_per_op << ", \"ops_per_sec\": " << result.ops_per_sec
+            << ", \"items_per_sec\": " << result.items_per_sec << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Читает ns_per_op из файла, записанного WriteJson. Каждый результат записан в отдельной строке
+std::map<std::string, double> ReadBaseline(std::istream& in) {
+    std::map<std::string, double> result;
+    constexpr std::string_view name_key = "\"name\": \"";
+    constexpr std::string_view ns_key = "\"ns_per_op\": ";
+
+    std::string line;
+    while (std::getline(in, line)) {
+        const auto name_pos = line.find(name_key);
+        const auto ns_pos = line.find(ns_key);
+        if (name_pos == std::string::npos || ns_pos == std::string::npos) {
+            continue;
+        }
+        const auto name_begin = name_pos + name_key.size();
+        const auto name_end = line.find('"', name_begin);
+        result[line.substr(name_begin, name_end - name_begin)] = std::strtod(line.c_str() + ns_pos + ns_key.size(), nullptr);
+    }
+    return result;
+}
+
+void PrintResults(const std::vector<Result>& results, const std::map<std::string, double>& baseline,
+                  std::ostream& out) {
+    out << std::left << std::setw(48) << "benchmark" << std::right << std::setw(14) << "ns/op"
+        << std::setw(14) << "ops/s" << std::setw(14) << "items/s";
+    if (!baseline.empty()) {
+        out << std::setw(12) << "vs base";
+    }
+    out << "\n" << std::fixed;
+
+    for (const auto& result : results) {
+        out << std::left << std::setw(48) << result.name << std::right
+            << std::setprecision(1) << std::setw(14) << result.ns_per_op
+            << std::setprecision(0) << std::setw(14) << result.ops_per_sec
+            << std::setw(14) << result.items_per_sec;
+        if (const auto it = baseline.find(result.name); it != baseline.end() && it->second > 0.) {
+            // Больше 1 - быстрее прежнего запуска
+            out << std::setprecision(2) << std::setw(11) << it->second / result.ns_per_op << "x";
+        }
+        out << "\n";
+    }
+}
+
+void PrintUsage(std::ostream& out) {
+    out << "Usage: LaminateSketchKernelBench [options]\n"
+           "Options:\n"
+           "      --filter <text>      run only benchmarks whose name contains the text\n"
+           "      --json <file>        save results as JSON\n"
+           "      --baseline <file>    compare with results saved by a previous run\n"
+           "      --min-time <sec>     minimal duration of one measurement (default: 0.5)\n"
+           "      --repetitions <n>    measurements per benchmark, the median is reported (default: 5)\n"
+           "      --seed <n>           seed of the synthetic inputs (default: 42)\n"
+           "  -h, --help               show this help\n";
+}
+
+std::optional<Settings> ParseArguments(int argc, char* argv[]) {
+    Settings settings;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const auto next = [&]() -> std::optional<std::string> {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return std::nullopt;
+            }
+            return std::string(argv[++i]);
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage(std::cout);
+            std::exit(EXIT_SUCCESS);
+        }
+        const auto value = next();
+        if (!value.has_value()) {
+            return std::nullopt;
+        }
+        if (arg == "--filter") {
+            settings.filter = *value;
+        }
+        else if (arg == "--json") {
+            settings.json_file = *value;
+        }
+        else if (arg == "--baseline") {
+            settings.baseline_file = *value;
+        }
+        else if (arg == "--min-time") {
+            settings.min_time = std::strtod(value->c_str(), nullptr);
+        }
+        else if (arg == "--repetitions") {
+            settings.repetitions = std::max(1ul, std::strtoul(value->c_str(), nullptr, 10));
+        }
+        else if (arg == "--seed") {
+            settings.seed = static_cast<unsigned>(std::strtoul(value->c_str(), nullptr, 10));
+        }
+        else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return std::nullopt;
+        }
+    }
+    if (settings.min_time <= 0.) {
+        std::cerr << "Minimal time must be positive" << std::endl;
+        return std::nullopt;
+    }
+    return settings;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const auto settings = ParseArguments(argc, argv);
+    if (!settings.has_value()) {
+        PrintUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!settings->baseline_file.empty()) {
+        std::ifstream in(settings->baseline_file);
+        if (!in) {
+            std::cerr << "Cannot read " << settings->baseline_file << std::endl;
+            return EXIT_FAILURE;
+        }
+        baseline = ReadBaseline(in);
+    }
+
+    std::uint64_t sink = 0;
+    std::vector<Result> results;
+    for (const auto& benchmark : MakeBenchmarks(settings->seed)) {
+        if (benchmark.name.find(settings->filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(Measure(benchmark, *settings, sink));
+    }
+
+    PrintResults(results, baseline, std::cout);
+    std::cout << "checksum " << sink << std::endl;
+
+    if (!settings->json_file.empty()) {
+        std::ofstream out(settings->json_file);
+        WriteJson(results, *settings, out);
+        if (!out) {
+            std::cerr << "Cannot write " << settings->json_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
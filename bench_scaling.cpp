@@ -0,0 +1,406 @@
+// Сквозной бенчмарк масштабирования: импорт, преобразование и оптимизация синтетических сечений разного размера
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "dx_handler.h"
+#include "ls_iface.h"
+#include "ls_synth.h"
+#include "memory_stats.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+    std::vector<size_t> plies{ 25, 50, 100, 200 };
+    domain::LaminateSpec spec;
+    double time_limit = 120.;       // Ограничение времени преобразования одного сечения, с. Ноль - без ограничения
+    fs::path csv_file;              // Пустой путь - только в стандартный вывод
+    fs::path dxf_dir;               // Пустой путь - входные файлы удаляются после импорта
+};
+
+// Этапы сквозной обработки в порядке выполнения
+enum Stage {
+    Generate,
+    Export,         // Запись синтетического эскиза в DXF
+    Import,         // Чтение DXF и получение "сырого" эскиза
+    Convert,
+    Publish,
+    Optimize,       // Оптимизация с параметрами по умолчанию
+    Sweep,          // Перебор сетки параметров оптимизации
+    StagesCount
+};
+
+constexpr std::string_view StageNames[StagesCount] = {
+    "generate", "export", "import", "convert", "publish", "optimize", "sweep"
+};
+
+struct Run {
+    size_t plies = 0;               // Слоев в одном сечении
+    size_t polylines = 0;
+    size_t points = 0;              // Точек импортированного эскиза
+    ls::ConversionStatus status = ls::ConversionStatus::Completed;
+    bool is_failed = false;         // Эскиз не удалось записать, прочитать или преобразовать
+    double seconds[StagesCount] = {};
+    domain::MemoryUsage memory[StagesCount];   // Заполняется в сборке с учетом памяти
+};
+
+// Сетка параметров для перебора: смещения и длины сегментов вокруг значений по умолчанию
+std::vector<ls::OptimizationParams> SweepGrid() {
+    std::vector<ls::OptimizationParams> result;
+    for (const double offset : { 0.5, 1., 2. }) {
+        for (const double segment_len : { 3., 5., 10. }) {
+            result.push_back({ .offset = offset, .segment_len = segment_len });
+        }
+    }
+    return result;
+}
+
+std::string_view StatusName(const Run& run) {
+    if (run.is_failed) {
+        return "failed";
+    }
+    switch (run.status) {
+    case ls::ConversionStatus::Completed: return "ok";
+    case ls::ConversionStatus::TimedOut: return "timeout";
+    case ls::ConversionStatus::Failed: return "partial";
+    }
+    return "unknown";
+}
+
+// Выполняет 'func' и добавляет время выполнения и расход памяти к этапу 'stage'
+template <typename Func>
+auto Timed(Run& run, Stage stage, Func&& func) {
+    domain::MemoryWindow memory;
+    const auto start = Clock::now();
+    auto finish = [&] {
+        run.seconds[stage] += std::chrono::duration<double>(Clock::now() - start).count();
+        run.memory[stage].add(memory.finish());
+    };
+    if constexpr (std::is_void_v<decltype(func())>) {
+        func();
+        finish();
+    }
+    else {
+        auto result = func();
+        finish();
+        return result;
+    }
+}
+
+Run Measure(size_t plies, const Settings& settings) {
+    Run run;
+    run.plies = plies;
+
+    domain::LaminateSpec spec = settings.spec;
+    spec.plies_count = plies;
+    const auto raw = Timed(run, Generate, [&] { return domain::GenerateLaminate(spec); });
+
+    const fs::path dir = settings.dxf_dir.empty() ? fs::temp_directory_path() : settings.dxf_dir;
+    const fs::path file = dir / ("laminate_" + std::to_string(plies) + "x" + std::to_string(spec.sections_count)
+                                 + "_" + std::to_string(spec.seed) + ".dxf");
+    const bool is_exported = Timed(run, Export, [&] {
+        dx::Handler handler;
+        handler.putRawSketch(raw);
+        return handler.exportFile(file.string(), DRW::AC1027, false);
+    });
+    if (!is_exported) {
+        run.is_failed = true;
+        return run;
+    }
+
+    std::optional<domain::RawData> imported = Timed(run, Import, [&]() -> std::optional<domain::RawData> {
+        dx::Handler handler;
+        if (!handler.importFile(file.string())) {
+            return std::nullopt;
+        }
+        return handler.getRawSketch();
+    });
+    if (settings.dxf_dir.empty()) {
+        std::error_code ec;
+        fs::remove(file, ec);
+    }
+    if (!imported.has_value()) {
+        run.is_failed = true;
+        return run;
+    }
+    run.polylines = imported->size();
+    for (const auto& polyline : *imported) {
+        run.points += polyline.pointsCount();
+    }
+
+    std::optional<Clock::duration> budget;
+    if (settings.time_limit > 0.) {
+        budget = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings.time_limit));
+    }
+    auto converted = Timed(run, Convert, [&] {
+        return ls::Interface::convertSketch(std::move(*imported), domain::Progress(std::stop_token{}, budget));
+    });
+    run.status = converted->report.status;
+
+    ls::Interface sketch;
+    if (!Timed(run, Publish, [&] { return sketch.setConverted(std::move(*converted)); })) {
+        run.is_failed = true;
+        return run;
+    }
+    Timed(run, Optimize, [&] { sketch.optimizeSketch(ls::Interface::DefaultOffset, ls::Interface::DefaultSegLen); });
+    Timed(run, Sweep, [&] { sketch.sweepParameters(SweepGrid()); });
+    return run;
+}
+
+void PrintRuns(const std::vector<Run>& runs, std::ostream& out) {
+    out << std::right << std::setw(8) << "plies" << std::setw(10) << "polylines" << std::setw(10) << "points";
+    for (const auto name : StageNames) {
+        out << std::setw(11) << name;
+    }
+    out << "  status\n" << std::fixed << std::setprecision(3);
+
+    for (const auto& run : runs) {
+        out << std::setw(8) << run.plies << std::setw(10) << run.polylines << std::setw(10) << run.points;
+        for (const double seconds : run.seconds) {
+            out << std::setw(11) << seconds;
+        }
+        out << "  " << StatusName(run) << "\n";
+    }
+
+    if (!domain::MemoryStatsAvailable()) {
+        return;
+    }
+    // Пик занятой памяти во время этапа: по нему оценивается память на один поток пакетной обработки
+    out << "\npeak memory, MB\n" << std::setw(28) << ' ';
+    for (const auto name : StageNames) {
+        out << std::setw(11) << name;
+    }
+    out << "\n" << std::setprecision(1);
+    for (const auto& run : runs) {
+        out << std::setw(8) << run.plies << std::setw(20) << ' ';
+        for (const auto& memory : run.memory) {
+            out << std::setw(11) << static_cast<double>(memory.peak_bytes) / (1024. * 1024.);
+        }
+        out << "\n";
+    }
+    out << std::setprecision(3);
+}
+
+// Показатель степени роста времени этапов между соседними размерами: 1 - линейный рост, 2 - квадратичный.
+// Для этапов короче миллисекунды и незавершенных преобразований не вычисляется
+void PrintExponents(const std::vector<Run>& runs, std::ostream& out) {
+    if (runs.size() < 2) {
+        return;
+    }
+    out << "\nscaling exponent (time ~ plies^k)\n" << std::setw(18) << "plies";
+    for (const auto name : StageNames) {
+        out << std::setw(11) << name;
+    }
+    out << "\n" << std::setprecision(2);
+
+    for (size_t i = 1; i < runs.size(); ++i) {
+        const Run& prev = runs[i - 1];
+        const Run& run = runs[i];
+        out << std::setw(8) << prev.plies << " -> " << std::setw(6) << run.plies;
+        const bool is_comparable = !prev.is_failed && !run.is_failed && run.plies != prev.plies
+            && prev.status == ls::ConversionStatus::Completed && run.status == ls::ConversionStatus::Completed;
+        for (size_t stage = 0; stage < StagesCount; ++stage) {
+            if (!is_comparable || prev.seconds[stage] < 1e-3 || run.seconds[stage] < 1e-3) {
+                out << std::setw(11) << "-";
+                continue;
+            }
+            out << std::setw(11) << std::log(run.seconds[stage] / prev.seconds[stage])
+                                    / std::log(static_cast<double>(run.plies) / static_cast<double>(prev.plies));
+        }
+        out << "\n";
+    }
+}
+
+void WriteCsv(const std::vector<Run>& runs, const Settings& settings, std::ostream& out) {
+    out << "plies,sections,seed,polylines,points";
+    for (const auto name : StageNames) {
+        out << "," << name << "_s";
+    }
+    if (domain::MemoryStatsAvailable()) {
+        for (const auto name : StageNames) {
+            out << "," << name << "_allocations," << name << "_peak_bytes";
+        }
+    }
+    out << ",status\n" << std::setprecision(6);
+
+    for (const auto& run : runs) {
+        out << run.plies << "," << settings.spec.sections_count << "," << settings.spec.seed << ","
+            << run.polylines << "," << run.points;
+        for (const double seconds : run.seconds) {
+            out << "," << seconds;
+        }
+        if (domain::MemoryStatsAvailable()) {
+            for (const auto& memory : run.memory) {
+                out << "," << memory.allocations << "," << memory.peak_bytes;
+            }
+        }
+        out << "," << StatusName(run) << "\n";
+    }
+}
+
+void PrintUsage(std::ostream& out) {
+    out << "Usage: LaminateSketchScalingBench [options]\n"
+           "Options:\n"
+           "      --plies <list>       comma separated plies per section (default: 25,50,100,200)\n"
+           "      --sections <count>   independent sections per sketch (default: 1)\n"
+           "      --seed <n>           seed of the synthetic sketches (default: 1)\n"
+           "      --span <mm>          section length (default: 300)\n"
+           "      --sag <mm>           tool surface sag, 0 - flat (default: 10)\n"
+           "      --drops <share>      share of plies dropped inside the section (default: 0.5)\n"
+           "      --ramp <mm>          ramp length over a ply drop (default: 4)\n"
+           "      --mix <0,90,45>      orientation shares (default: 0.4,0.2,0.4)\n"
+           "      --time-limit <sec>   limit the conversion time per sketch, 0 - no limit (default: 120)\n"
+           "      --csv <file>         also write the results as CSV\n"
+           "      --dxf-dir <dir>      keep the generated DXF files in the directory\n"
+           "  -h, --help               show this help\n";
+}
+
+std::vector<double> ParseList(const std::string& value) {
+    std::vector<double> result;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        result.push_back(std::stod(item));
+    }
+    return result;
+}
+
+// Разбирает аргументы командной строки. При ошибке возвращает std::nullopt
+std::optional<Settings> ParseArguments(int argc, char* argv[]) {
+    Settings settings;
+    domain::LaminateSpec& spec = settings.spec;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage(std::cout);
+            std::exit(EXIT_SUCCESS);
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return std::nullopt;
+        }
+        const std::string value = argv[++i];
+
+        try {
+            if (arg == "--plies") {
+                settings.plies.clear();
+                for (const double plies : ParseList(value)) {
+                    if (plies < 1.) {
+                        throw std::invalid_argument("plies");
+                    }
+                    settings.plies.push_back(static_cast<size_t>(plies));
+                }
+            }
+            else if (arg == "--sections") {
+                spec.sections_count = std::max(1, std::stoi(value));
+            }
+            else if (arg == "--seed") {
+                spec.seed = static_cast<unsigned>(std::stoul(value));
+            }
+            else if (arg == "--span") {
+                spec.length = std::stod(value);
+            }
+            else if (arg == "--sag") {
+                spec.sag = std::stod(value);
+            }
+            else if (arg == "--drops") {
+                spec.drop_share = std::stod(value);
+            }
+            else if (arg == "--ramp") {
+                spec.ramp_length = std::stod(value);
+            }
+            else if (arg == "--mix") {
+                const auto shares = ParseList(value);
+                if (shares.size() != 3) {
+                    throw std::invalid_argument("mix");
+                }
+                spec.orientations = { .zero = shares[0], .perpendicular = shares[1], .other = shares[2] };
+            }
+            else if (arg == "--time-limit") {
+                settings.time_limit = std::stod(value);
+            }
+            else if (arg == "--csv") {
+                settings.csv_file = value;
+            }
+            else if (arg == "--dxf-dir") {
+                settings.dxf_dir = value;
+            }
+            else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return std::nullopt;
+            }
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return std::nullopt;
+        }
+    }
+
+    if (settings.plies.empty()) {
+        std::cerr << "No sizes to measure" << std::endl;
+        return std::nullopt;
+    }
+    if (spec.length <= 0. || spec.ramp_length <= 0.) {
+        std::cerr << "Span and ramp length must be positive" << std::endl;
+        return std::nullopt;
+    }
+    const auto& mix = spec.orientations;
+    if (mix.zero < 0. || mix.perpendicular < 0. || mix.other < 0. || mix.zero + mix.perpendicular + mix.other <= 0.) {
+        std::cerr << "Orientation shares must not be negative and must not all be zero" << std::endl;
+        return std::nullopt;
+    }
+    if (settings.time_limit < 0.) {
+        std::cerr << "Time limit must not be negative" << std::endl;
+        return std::nullopt;
+    }
+    return settings;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const auto settings = ParseArguments(argc, argv);
+    if (!settings.has_value()) {
+        PrintUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Run> runs;
+    for (const size_t plies : settings->plies) {
+        runs.push_back(Measure(plies, *settings));
+        // Промежуточный результат: большие сечения преобразуются долго
+        std::cerr << plies << " plies: " << StatusName(runs.back()) << std::endl;
+    }
+
+    PrintRuns(runs, std::cout);
+    PrintExponents(runs, std::cout);
+
+    if (!settings->csv_file.empty()) {
+        std::ofstream out(settings->csv_file);
+        WriteCsv(runs, *settings, out);
+        if (!out) {
+            std::cerr << "Cannot write " << settings->csv_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
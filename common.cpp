@@ -1,10 +1,14 @@
 #include "common.h"
+#include "counters.h"
+#include "timing.h"
 
 namespace domain {
 
 std::optional<Point> FindSegmentsIntersection(const Point& p1, const Point& p2, const Point& p3, const Point& p4,
     double abs_epsilon, double rel_epsilon)
 {
+    Count(Counter::SegmentIntersections);
+
     // Вычисляем знаменатель
     double denominator = (p4.x - p3.x) * (p2.y - p1.y) - (p2.x - p1.x) * (p4.y - p3.y);
 
@@ -45,6 +49,7 @@ std::optional<Point> FindLinesIntersection(const Point& p1, const Point& p2,
 }
 
 bool IsPointInPolygon(const Point& test, const Polygon& polygon) {
+    Count(Counter::PointInPolygon);
 
     bool is_inside = false;
 
@@ -114,6 +119,7 @@ Point GetPerpendicularPoint(const Point& start, const Point& end, double offset)
 
 
 Polyline OffsetPolyline(const Polyline& polyline, double offset) {
+    Count(Counter::PolylineOffsets);
     Polyline result;
     if (polyline.size() < 2) {
         return {};
@@ -250,6 +256,7 @@ RawPolyline RemoveExtraDots(const RawPolyline& input, double abs_epsilon, double
     if (input.polyline.empty()) return result;
 
     result.orientation = input.orientation;
+    result.meta = input.meta;
     result.polyline.reserve(input.polyline.size());
 
     // Всегда добавляем первую точку
@@ -275,6 +282,7 @@ RawPolyline RemoveExtraDots(const RawPolyline& input, double abs_epsilon, double
 }
 
 RawData RemoveExtraDots(const RawData& data, double abs_epsilon, double rel_epsilon) {
+    const StageTimer timer("remove extra dots");
     RawData result;
 
     for (const auto& polyline : data) {
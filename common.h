@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cmath>
 #include <compare>
+#include <cstdint>
 #include <limits>
 #include <list>
 #include <numbers>
@@ -33,6 +34,41 @@ inline bool operator!=(const Point& lhs, const Point& rhs) {
 
 using Polyline = std::vector<Point>;
 
+// Габаритный прямоугольник. Пустой, пока не добавлена ни одна точка
+struct BoundingBox {
+    double left = std::numeric_limits<double>::max();
+    double bottom = std::numeric_limits<double>::max();
+    double right = std::numeric_limits<double>::lowest();
+    double top = std::numeric_limits<double>::lowest();
+
+    void extend(const Point& point) noexcept {
+        left = std::min(left, point.x);
+        right = std::max(right, point.x);
+        bottom = std::min(bottom, point.y);
+        top = std::max(top, point.y);
+    }
+    void extend(const BoundingBox& other) noexcept {
+        left = std::min(left, other.left);
+        right = std::max(right, other.right);
+        bottom = std::min(bottom, other.bottom);
+        top = std::max(top, other.top);
+    }
+
+    [[nodiscard]] bool isEmpty() const noexcept { return left > right || bottom > top; }
+    [[nodiscard]] double width() const noexcept { return isEmpty() ? 0. : right - left; }
+    [[nodiscard]] double height() const noexcept { return isEmpty() ? 0. : top - bottom; }
+
+    // Проверки с запасом 'margin' вокруг прямоугольника
+    [[nodiscard]] bool contains(const Point& point, double margin = 0.) const noexcept {
+        return point.x >= left - margin && point.x <= right + margin
+               && point.y >= bottom - margin && point.y <= top + margin;
+    }
+    [[nodiscard]] bool intersects(const BoundingBox& other, double margin = 0.) const noexcept {
+        return other.left <= right + margin && other.right >= left - margin
+               && other.bottom <= top + margin && other.top >= bottom - margin;
+    }
+};
+
 // Направление укладки сегмента
 enum class Orientation {
     NoOrientation,
@@ -41,9 +77,14 @@ enum class Orientation {
     Other       // +-45 и другие
 };
 
+// Номер данных исходного слоя в таблице PlyMetaTable (см. ls_meta.h)
+using PlyMetaId = std::uint32_t;
+constexpr PlyMetaId NoPlyMeta = 0;     // Данные исходного слоя отсутствуют
+
 struct RawPolyline {
     Polyline polyline;
     domain::Orientation orientation = domain::Orientation::Zero;
+    PlyMetaId meta = NoPlyMeta;
 
     // Метры доступа
     [[nodiscard]] size_t pointsCount() const noexcept { return polyline.size(); }
@@ -0,0 +1,35 @@
+#include "counters.h"
+
+namespace domain {
+
+std::string_view CounterName(Counter counter) {
+    switch (counter) {
+    case Counter::SegmentIntersections: return "segment_intersections";
+    case Counter::PointInPolygon: return "point_in_polygon";
+    case Counter::PolylineOffsets: return "polyline_offsets";
+    case Counter::UpperPlyChecks: return "upper_ply_checks";
+    case Counter::LinkAttempts: return "link_attempts";
+    case Counter::NodeInsertions: return "node_insertions";
+    case Counter::CountersCount: break;
+    }
+    return "unknown";
+}
+
+void CounterSet::merge(const CounterValues& values) {
+    std::lock_guard lock(mutex_);
+    for (size_t i = 0; i < CountersCount; ++i) {
+        values_[i] += values[i];
+    }
+}
+
+CounterValues CounterSet::values() const {
+    std::lock_guard lock(mutex_);
+    return values_;
+}
+
+void CounterSet::clear() {
+    std::lock_guard lock(mutex_);
+    values_.fill(0);
+}
+
+} // namespace domain
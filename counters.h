@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+namespace domain {
+
+// Счетчики вызовов геометрических проверок включаются при сборке опцией LAMINATESKETCH_COUNTERS.
+// Без нее Count() и CounterScope не генерируют кода
+#ifdef LAMINATESKETCH_COUNTERS
+constexpr bool CountersEnabled = true;
+#else
+constexpr bool CountersEnabled = false;
+#endif
+
+enum class Counter {
+    SegmentIntersections,   // Проверки пересечения пары отрезков
+    PointInPolygon,         // Проверки принадлежности точки многоугольнику
+    PolylineOffsets,        // Построения смещенных ломаных
+    UpperPlyChecks,         // Проверки принадлежности ломаной верхнему слою
+    LinkAttempts,           // Попытки соединить узел с сегментом (TryConnectIntersection)
+    NodeInsertions,         // Узлы, добавленные в сегменты при соединении слоев
+    CountersCount
+};
+
+constexpr size_t CountersCount = static_cast<size_t>(Counter::CountersCount);
+
+using CounterValues = std::array<std::uint64_t, CountersCount>;
+
+// Имя счетчика для отчетов, например "segment_intersections"
+std::string_view CounterName(Counter counter);
+
+// Итог счетчиков: значения потоков добавляются при завершении их CounterScope
+class CounterSet {
+public:
+    void merge(const CounterValues& values);
+    CounterValues values() const;
+    void clear();
+
+private:
+    mutable std::mutex mutex_;
+    CounterValues values_{};
+};
+
+namespace detail {
+
+// Счетчики текущего потока и итог, в который они будут добавлены
+struct ThreadCounters {
+    CounterSet* set = nullptr;
+    CounterValues* values = nullptr;    // nullptr - подсчет выключен
+};
+
+inline thread_local ThreadCounters CurrentCounters;
+
+} // namespace detail
+
+inline CounterSet* CurrentCounterSet() {
+    if constexpr (CountersEnabled) {
+        return detail::CurrentCounters.set;
+    }
+    else {
+        return nullptr;
+    }
+}
+
+// Увеличивает счетчик текущего потока. Потоки не разделяют счетчики, поэтому синхронизация не нужна
+inline void Count(Counter counter, std::uint64_t count = 1) {
+    if constexpr (CountersEnabled) {
+        if (CounterValues* values = detail::CurrentCounters.values) {
+            (*values)[static_cast<size_t>(counter)] += count;
+        }
+    }
+}
+
+// Ведет счетчики текущего потока на время своего существования и добавляет их в 'set'
+// при разрушении. nullptr выключает подсчет. ParallelFor продолжает подсчет вызывающего
+// потока в своих задачах
+class CounterScope {
+public:
+    explicit CounterScope(CounterSet* set) {
+        if constexpr (CountersEnabled) {
+            previous_ = std::exchange(detail::CurrentCounters,
+                                      { .set = set, .values = (set != nullptr) ? &values_ : nullptr });
+        }
+    }
+
+    ~CounterScope() {
+        if constexpr (CountersEnabled) {
+            if (detail::CurrentCounters.set != nullptr) {
+                detail::CurrentCounters.set->merge(values_);
+            }
+            detail::CurrentCounters = previous_;
+        }
+    }
+
+    CounterScope(const CounterScope&) = delete;
+    CounterScope& operator=(const CounterScope&) = delete;
+
+private:
+    detail::ThreadCounters previous_;
+    CounterValues values_{};
+};
+
+} // namespace domain
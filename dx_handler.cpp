@@ -1,12 +1,61 @@
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <iomanip>
 #include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
 
 #include "dx_handler.h"
+#include "timing.h"
 
 namespace dx {
 
-domain::RawData ConvertDataToRawSketch(const Data& data) {
+// Слой отметок сравнения редакций. Его линии повторяют линии слоев и не импортируются
+const std::string DiffLayerName = "SketchDiff";
+
+// Слой ломаных эскиза, исходный слой которых неизвестен
+const std::string SketchLayerName = "SketchLayer";
+
+// Код группы расширенных данных: в разных версиях libdxfrw это поле или метод
+template <typename Variant>
+int GetExtDataCode(const Variant& variant) {
+    if constexpr (requires { variant.code(); }) {
+        return variant.code();
+    }
+    else {
+        return variant.code;
+    }
+}
+
+// Данные исходного слоя примитива: имя слоя, дескриптор и значения строк
+// расширенных данных (код 1000) вида "MATERIAL=..." и "PLY_ID=..."
+domain::PlyMeta GetEntityMeta(const DRW_Entity& entity) {
+    domain::PlyMeta meta{ .layer = entity.layer };
+
+    std::ostringstream handle;
+    handle << std::uppercase << std::hex << entity.handle;
+    meta.handle = handle.str();
+
+    constexpr std::string_view material_key = "MATERIAL=";
+    constexpr std::string_view ply_id_key = "PLY_ID=";
+    for (const auto& item : entity.extData) {
+        if (!item || GetExtDataCode(*item) != 1000 || item->content.s == nullptr) {
+            continue;
+        }
+        const std::string_view value = *item->content.s;
+        if (value.starts_with(material_key)) {
+            meta.material = value.substr(material_key.size());
+        }
+        else if (value.starts_with(ply_id_key)) {
+            meta.ply_id = value.substr(ply_id_key.size());
+        }
+    }
+    return meta;
+}
+
+domain::RawData ConvertDataToRawSketch(const Data& data, domain::PlyMetaTable& meta_table) {
     domain::RawData result;
 
     // Общая лямбда для обработки полилиний
@@ -54,16 +103,30 @@ domain::RawData ConvertDataToRawSketch(const Data& data) {
     };
 
     for (const auto& entity : data.mBlock->ent) {
+        if (entity->layer == DiffLayerName) {
+            continue;
+        }
         switch (entity->eType) {
         case DRW::ETYPE::POLYLINE:
         case DRW::ETYPE::LWPOLYLINE: // Объединенная обработка
-            result.emplace_back(process_polyline(
+        {
+            auto& new_layer = result.emplace_back(process_polyline(
                 static_cast<DRW_Polyline*>(entity.get())));
+            new_layer.meta = meta_table.intern(GetEntityMeta(*entity));
+            // Замкнутая по флагу полилиния - контур заполнителя, замыкаем его явно
+            const int flags = (entity->eType == DRW::ETYPE::POLYLINE)
+                                  ? static_cast<DRW_Polyline*>(entity.get())->flags
+                                  : static_cast<DRW_LWPolyline*>(entity.get())->flags;
+            if ((flags & 1) && !new_layer.isEmpty()) {
+                new_layer.append(new_layer.polyline.front());
+            }
             break;
+        }
 
         case DRW::ETYPE::SPLINE:
             result.emplace_back(process_spline(
-                static_cast<DRW_Spline*>(entity.get())));
+                static_cast<DRW_Spline*>(entity.get())))
+                .meta = meta_table.intern(GetEntityMeta(*entity));
             break;
 
         default:
@@ -75,11 +138,13 @@ domain::RawData ConvertDataToRawSketch(const Data& data) {
     return domain::RemoveExtraDots(result, 1e-3);
 }
 
-void ConvertRawSketchToData(const domain::RawData& sketch, Data& data) {
+void ConvertRawSketchToData(const domain::RawData& sketch, const domain::PlyMetaTable& meta_table, Data& data) {
 
     for (const auto& sketch_layer : sketch) {
         auto new_polyline = std::make_unique<DRW_LWPolyline>();
-        new_polyline->layer = "SketchLayer";
+        // Ломаная сохраняется на слое исходного файла, из которого она получена
+        const std::string_view source_layer = meta_table.layer(sketch_layer.meta);
+        new_polyline->layer = source_layer.empty() ? SketchLayerName : std::string(source_layer);
         switch (sketch_layer.orientation)
         {
         case domain::Orientation::Zero: new_polyline->color = 4;
@@ -100,24 +165,219 @@ void ConvertRawSketchToData(const domain::RawData& sketch, Data& data) {
     }
 }
 
+void ConvertCoresToData(const std::vector<domain::Polygon>& cores, Data& data) {
+
+    for (const auto& core : cores) {
+        const auto& points = core.points();
+        if (points.size() < 3) {
+            continue;
+        }
+
+        // Контур сохраняется замкнутой полилинией, чтобы при повторном импорте
+        // заполнитель снова был распознан
+        auto outline = std::make_unique<DRW_LWPolyline>();
+        outline->layer = "SketchCores";
+        outline->flags = 1;
+        for (const auto& point : points) {
+            outline->addVertex(DRW_Vertex2D(point.x, point.y, 0.));
+        }
+        data.mBlock->ent.push_back(std::move(outline));
+
+        // Граница штриховки задается отрезками: полилинейные границы libdxfrw не записывает
+        auto* loop = new DRW_HatchLoop(1);
+        using Edge = decltype(loop->objlist)::value_type;
+        for (size_t i = 0; i < points.size(); ++i) {
+            const auto& next = points[(i + 1) % points.size()];
+            auto* edge = new DRW_Line();
+            edge->basePoint = DRW_Coord(points[i].x, points[i].y, 0.);
+            edge->secPoint = DRW_Coord(next.x, next.y, 0.);
+            loop->objlist.push_back(Edge(edge));
+        }
+        loop->update();
+
+        auto hatch = std::make_unique<DRW_Hatch>();
+        hatch->layer = "SketchCores";
+        hatch->name = "ANSI31";
+        hatch->solid = 0;
+        hatch->associative = 0;
+        hatch->hstyle = 0;
+        hatch->hpattern = 1;
+        hatch->doubleflag = 0;
+        hatch->angle = 0.;
+        hatch->scale = 0.5;
+        hatch->deflines = 0;
+        hatch->appendLoop(loop);
+        hatch->loopsnum = static_cast<int>(hatch->looplist.size());
+        data.mBlock->ent.push_back(std::move(hatch));
+    }
+}
+
+void ConvertPlyLabelsToData(const std::vector<domain::PlyLabel>& labels, Data& data) {
+
+    for (const auto& label : labels) {
+        auto leader = std::make_unique<DRW_Leader>();
+        leader->layer = "SketchLabels";
+        leader->style = "Standard";
+        leader->arrow = 0;
+        leader->textheight = label.height;
+        leader->textwidth = domain::LabelTextWidth(label.text, label.height);
+        // Тип указателей в списке вершин зависит от версии libdxfrw
+        using Vertex = decltype(leader->vertexlist)::value_type;
+        leader->vertexlist.push_back(Vertex(new DRW_Coord(label.anchor.x, label.anchor.y, 0.)));
+        leader->vertexlist.push_back(Vertex(new DRW_Coord(label.leader_end.x, label.leader_end.y, 0.)));
+        leader->vertnum = static_cast<int>(leader->vertexlist.size());
+        data.mBlock->ent.push_back(std::move(leader));
+
+        auto text = std::make_unique<DRW_Text>();
+        text->layer = "SketchLabels";
+        text->text = label.text;
+        text->height = label.height;
+        text->basePoint = DRW_Coord(label.position.x, label.position.y, 0.);
+        data.mBlock->ent.push_back(std::move(text));
+    }
+}
+
+void ConvertThicknessTableToData(const std::vector<domain::ProfileStation>& stations, domain::Point origin,
+                                 double text_height, Data& data) {
+    if (stations.empty()) {
+        return;
+    }
+
+    constexpr size_t columns_count = 7;
+    using Row = std::array<std::string, columns_count>;
+
+    auto format = [](double value) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << value;
+        return out.str();
+    };
+
+    std::vector<Row> rows;
+    rows.reserve(stations.size() + 1);
+    rows.push_back({ "X, mm", "Plies", "Thickness, mm", "0%%d", "90%%d", "Other", "Drop" });
+    for (const auto& station : stations) {
+        rows.push_back({ format(station.x), std::to_string(station.plies), format(station.thickness),
+                         std::to_string(station.zero), std::to_string(station.perpendicular),
+                         std::to_string(station.other), std::to_string(station.drop) });
+    }
+
+    // Ширина столбца - по самому длинному тексту с полями в половину высоты текста
+    std::array<double, columns_count> widths{};
+    for (const auto& row : rows) {
+        for (size_t i = 0; i < columns_count; ++i) {
+            const size_t length = (i == 3 || i == 4) ? row[i].size() - 2 : row[i].size(); // "%%d" - один знак
+            widths[i] = std::max(widths[i], domain::LabelTextWidth(std::string(length, ' '), text_height) + text_height);
+        }
+    }
+    double table_width = 0.;
+    for (const double width : widths) {
+        table_width += width;
+    }
+    const double row_height = 2. * text_height;
+    const double table_height = row_height * static_cast<double>(rows.size());
+
+    auto add_line = [&data](double x1, double y1, double x2, double y2) {
+        auto line = std::make_unique<DRW_Line>();
+        line->layer = "SketchProfile";
+        line->basePoint = DRW_Coord(x1, y1, 0.);
+        line->secPoint = DRW_Coord(x2, y2, 0.);
+        data.mBlock->ent.push_back(std::move(line));
+    };
+
+    // 'origin' - левый верхний угол таблицы
+    for (size_t i = 0; i <= rows.size(); ++i) {
+        const double y = origin.y - row_height * static_cast<double>(i);
+        add_line(origin.x, y, origin.x + table_width, y);
+    }
+    double x = origin.x;
+    add_line(x, origin.y, x, origin.y - table_height);
+    for (const double width : widths) {
+        x += width;
+        add_line(x, origin.y, x, origin.y - table_height);
+    }
+
+    for (size_t r = 0; r < rows.size(); ++r) {
+        const double y = origin.y - row_height * static_cast<double>(r + 1) + text_height / 2.;
+        double cell_x = origin.x;
+        for (size_t i = 0; i < columns_count; ++i) {
+            auto text = std::make_unique<DRW_Text>();
+            text->layer = "SketchProfile";
+            text->text = rows[r][i];
+            text->height = text_height;
+            text->basePoint = DRW_Coord(cell_x + text_height / 2., y, 0.);
+            data.mBlock->ent.push_back(std::move(text));
+            cell_x += widths[i];
+        }
+    }
+}
+
+void ConvertDiffToData(const std::vector<domain::DiffHighlight>& highlights, double marker_radius, Data& data) {
+
+    for (const auto& highlight : highlights) {
+        if (highlight.polyline.empty()) {
+            continue;
+        }
+
+        // Удаленный слой отмечается окружностью в ближайшем к нему узле новой редакции
+        if (highlight.kind == domain::PlyChangeKind::Removed) {
+            auto marker = std::make_unique<DRW_Circle>();
+            marker->layer = DiffLayerName;
+            marker->color = 1;
+            marker->basePoint = DRW_Coord(highlight.polyline.front().x, highlight.polyline.front().y, 0.);
+            marker->radious = marker_radius;
+            data.mBlock->ent.push_back(std::move(marker));
+            continue;
+        }
+
+        auto polyline = std::make_unique<DRW_LWPolyline>();
+        polyline->layer = DiffLayerName;
+        polyline->color = (highlight.kind == domain::PlyChangeKind::Added) ? 3 : 30;
+        for (const auto& point : highlight.polyline) {
+            polyline->addVertex(DRW_Vertex2D(point.x, point.y, 0.));
+        }
+        data.mBlock->ent.push_back(std::move(polyline));
+    }
+}
+
 bool Handler::importFile(std::string file_name) {
+    const domain::StageTimer timer("import");
     Iface input;
     inputData = {};
     return input.fileImport(file_name, &inputData);
 }
 bool Handler::exportFile(std::string file_name, DRW::Version version, bool is_binary) {
+    const domain::StageTimer timer("export");
     Iface output;
     bool success = output.fileExport(file_name, version, is_binary, &outputData);
     outputData = {};
     return success;
 }
 
-domain::RawData Handler::getRawSketch() const {
-    return ConvertDataToRawSketch(inputData);
+domain::RawData Handler::getRawSketch() {
+    const domain::StageTimer timer("raw sketch");
+    return ConvertDataToRawSketch(inputData, plyMetaTable);
 }
 
 void Handler::putRawSketch(const domain::RawData raw_sketch) {
-    ConvertRawSketchToData(raw_sketch, outputData);
+    const domain::StageTimer timer("put sketch");
+    ConvertRawSketchToData(raw_sketch, plyMetaTable, outputData);
+}
+
+void Handler::putCores(const std::vector<domain::Polygon>& cores) {
+    ConvertCoresToData(cores, outputData);
+}
+
+void Handler::putPlyLabels(const std::vector<domain::PlyLabel>& labels) {
+    ConvertPlyLabelsToData(labels, outputData);
+}
+
+void Handler::putSketchDiff(const std::vector<domain::DiffHighlight>& highlights, double marker_radius) {
+    ConvertDiffToData(highlights, marker_radius, outputData);
+}
+
+void Handler::putThicknessTable(const std::vector<domain::ProfileStation>& profile, domain::Point origin,
+                                double text_height) {
+    ConvertThicknessTableToData(domain::GetProfileKeyStations(profile), origin, text_height, outputData);
 }
 
 } // namespace dxf
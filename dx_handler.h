@@ -1,7 +1,13 @@
 #pragma once
 
+#include <vector>
+
 #include "common.h"
 #include "dx_iface.h"
+#include "ls_diff.h"
+#include "ls_labels.h"
+#include "ls_meta.h"
+#include "ls_profile.h"
 
 namespace dx {
 
@@ -11,12 +17,30 @@ public:
     bool importFile(std::string file_name);
     bool exportFile(std::string file_name, DRW::Version version, bool is_binary);
 
-    domain::RawData getRawSketch() const;
+    // Ломаные импортированного файла. Данные их исходных слоев (имя слоя, материал,
+    // обозначение слоя укладки, дескриптор) добавляются в таблицу plyMeta()
+    domain::RawData getRawSketch();
+    // Ломаные сохраняются на слоях исходного файла по данным из таблицы plyMeta()
     void putRawSketch(const domain::RawData raw_sketch);
+    // Добавляет в выходной файл заполнители: замкнутый контур и штриховку (HATCH)
+    void putCores(const std::vector<domain::Polygon>& cores);
+    // Добавляет в выходной файл номера слоев (TEXT) с выносками (LEADER)
+    void putPlyLabels(const std::vector<domain::PlyLabel>& labels);
+    // Добавляет в выходной файл отметки изменений относительно прежней редакции на отдельном слое:
+    // линии добавленных (зеленые) и измененных (оранжевые) слоев, окружности на месте удаленных
+    void putSketchDiff(const std::vector<domain::DiffHighlight>& highlights, double marker_radius);
+    // Добавляет в выходной файл таблицу профиля толщины (отрезки и TEXT) с левым верхним углом в 'origin'.
+    // В таблицу попадают станции сброса слоев и крайние станции сечений
+    void putThicknessTable(const std::vector<domain::ProfileStation>& profile, domain::Point origin,
+                           double text_height);
+
+    // Данные исходных слоев всех импортированных этим обработчиком файлов
+    const domain::PlyMetaTable& plyMeta() const noexcept { return plyMetaTable; }
 
 private:
     Data inputData;
     Data outputData;
+    domain::PlyMetaTable plyMetaTable;
 };
 
 } // namespace dxf
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ls_cleanup.h"
+#include "ls_cores.h"
+#include "timing.h"
+
+namespace domain {
+
+namespace {
+
+using CellKey = std::pair<std::int64_t, std::int64_t>;
+
+struct CellHash {
+    size_t operator()(const CellKey& key) const noexcept {
+        return std::hash<std::int64_t>{}(key.first * 73856093 ^ key.second * 19349663);
+    }
+};
+
+// Сводит близкие концы открытых ломаных в общие точки, возвращает число перемещенных концов.
+// Концы собираются в группы, все концы которых попарно отстоят не более чем на 'tolerance':
+// иначе цепочка концов с шагом меньше допуска сводилась бы в одну точку, далекую от крайних концов.
+// Общая точка группы - центр ее концов, поэтому каждый конец смещается не более чем на 'tolerance'.
+// В 'partners' для каждого конца записывается единственный парный конец другой ломаной
+// того же направления укладки, если в точке сходятся ровно два конца
+size_t WeldEndpoints(const std::vector<RawPolyline*>& polylines, double tolerance,
+                     std::vector<std::optional<size_t>>& partners) {
+    // Конец 2 * i - первая точка ломаной i, 2 * i + 1 - последняя
+    auto endpoint = [&polylines](size_t index) -> Point& {
+        auto& polyline = polylines[index / 2]->polyline;
+        return (index % 2 == 0) ? polyline.front() : polyline.back();
+    };
+    auto cell_of = [tolerance](const Point& point) {
+        return CellKey{ static_cast<std::int64_t>(std::floor(point.x / tolerance)),
+                        static_cast<std::int64_t>(std::floor(point.y / tolerance)) };
+    };
+
+    const size_t count = polylines.size() * 2;
+    constexpr size_t no_group = std::numeric_limits<size_t>::max();
+    std::vector<size_t> group_of(count, no_group);
+    std::vector<std::vector<size_t>> groups;
+
+    std::unordered_map<CellKey, std::vector<size_t>, CellHash> grid;
+    grid.reserve(count);
+
+    // Конец присоединяется к ближайшей по первому концу группе, с каждым концом которой он совпадает.
+    // Концы одной ломаной не свариваются: это вырождает короткую ломаную
+    auto fits = [&](size_t index, size_t group) {
+        return std::all_of(groups[group].begin(), groups[group].end(), [&](size_t other) {
+            return other / 2 != index / 2 && DistanceBetweenPoints(endpoint(index), endpoint(other)) <= tolerance;
+        });
+    };
+
+    for (size_t index = 0; index < count; ++index) {
+        const Point& point = endpoint(index);
+        const auto [cx, cy] = cell_of(point);
+
+        size_t best = no_group;
+        double best_distance = std::numeric_limits<double>::max();
+        for (std::int64_t dx = -1; dx <= 1; ++dx) {
+            for (std::int64_t dy = -1; dy <= 1; ++dy) {
+                const auto it = grid.find({ cx + dx, cy + dy });
+                if (it == grid.end()) {
+                    continue;
+                }
+                for (const size_t other : it->second) {
+                    const size_t group = group_of[other];
+                    const double distance = DistanceBetweenPoints(point, endpoint(groups[group].front()));
+                    if (group != best && distance < best_distance && fits(index, group)) {
+                        best = group;
+                        best_distance = distance;
+                    }
+                }
+            }
+        }
+
+        if (best == no_group) {
+            best = groups.size();
+            groups.emplace_back();
+        }
+        groups[best].push_back(index);
+        group_of[index] = best;
+        grid[{ cx, cy }].push_back(index);
+    }
+
+    size_t welded = 0;
+    partners.assign(count, std::nullopt);
+
+    for (const auto& group : groups) {
+        if (group.size() < 2) {
+            continue;
+        }
+
+        Point center{ 0., 0. };
+        for (const size_t index : group) {
+            center.x += endpoint(index).x;
+            center.y += endpoint(index).y;
+        }
+        center.x /= static_cast<double>(group.size());
+        center.y /= static_cast<double>(group.size());
+
+        for (const size_t index : group) {
+            Point& point = endpoint(index);
+            if (point.x != center.x || point.y != center.y) {
+                point = center;
+                ++welded;
+            }
+        }
+
+        if (group.size() == 2
+            && polylines[group[0] / 2]->orientation == polylines[group[1] / 2]->orientation) {
+            partners[group[0]] = group[1];
+            partners[group[1]] = group[0];
+        }
+    }
+    return welded;
+}
+
+// Объединяет открытые цепочки ломаных, связанных парными концами. Результат цепочки записывается
+// в ее первую ломаную, остальные ломаные добавляются в 'removed'. Возвращает число присоединенных ломаных.
+// Замкнутые цепочки не объединяются: объединенная ломаная стала бы замкнутым контуром и была бы
+// принята за заполнитель, хотя это, например, слой и обратный слой, соприкасающиеся концами
+size_t JoinChains(const std::vector<RawPolyline*>& polylines, const std::vector<std::optional<size_t>>& partners,
+                  std::unordered_set<const RawPolyline*>& removed) {
+    std::vector<bool> visited(polylines.size(), false);
+    size_t joined = 0;
+
+    auto join_from = [&](size_t start, bool reversed) {
+        visited[start] = true;
+
+        Polyline result = polylines[start]->polyline;
+        if (reversed) {
+            std::reverse(result.begin(), result.end());
+        }
+        size_t exit = reversed ? start * 2 : start * 2 + 1;
+
+        while (partners[exit].has_value()) {
+            const size_t entry = *partners[exit];
+            const size_t next = entry / 2;
+            if (visited[next]) {
+                break;  // Цепочка замкнулась
+            }
+            visited[next] = true;
+
+            const auto& points = polylines[next]->polyline;
+            if (entry % 2 == 0) {
+                result.insert(result.end(), points.begin() + 1, points.end());
+                exit = next * 2 + 1;
+            }
+            else {
+                result.insert(result.end(), points.rbegin() + 1, points.rend());
+                exit = next * 2;
+            }
+            removed.insert(polylines[next]);
+            ++joined;
+        }
+
+        // Первая ломаная цепочки сохраняет свое направление
+        if (reversed) {
+            std::reverse(result.begin(), result.end());
+        }
+        polylines[start]->polyline = std::move(result);
+    };
+
+    // Сначала открытые цепочки - от свободного конца
+    for (size_t i = 0; i < polylines.size(); ++i) {
+        if (visited[i]) {
+            continue;
+        }
+        if (!partners[i * 2].has_value()) {
+            join_from(i, false);
+        }
+        else if (!partners[i * 2 + 1].has_value()) {
+            join_from(i, true);
+        }
+    }
+    // Оставшиеся ломаные образуют замкнутые цепочки и остаются отдельными слоями
+    return joined;
+}
+
+// Признак того, что в каноническом направлении точки ломаной идут в обратном порядке:
+// канонически первая точка не больше последней
+bool IsReversedCanonical(const Polyline& polyline) {
+    const Point& front = polyline.front();
+    const Point& back = polyline.back();
+    return std::tie(back.x, back.y) < std::tie(front.x, front.y);
+}
+
+bool IsSamePolyline(const RawPolyline& lhs, const RawPolyline& rhs) {
+    if (lhs.orientation != rhs.orientation || lhs.pointsCount() != rhs.pointsCount()) {
+        return false;
+    }
+    return std::equal(lhs.polyline.begin(), lhs.polyline.end(), rhs.polyline.begin())
+           || std::equal(lhs.polyline.begin(), lhs.polyline.end(), rhs.polyline.rbegin());
+}
+
+// Отмечает в 'removed' точные копии ранее встреченных ломаных, возвращает их число.
+// Копии ищутся по хешу точек в каноническом направлении
+size_t FindDuplicates(const RawData& raw_sketch, std::unordered_set<const RawPolyline*>& removed) {
+    std::unordered_map<size_t, std::vector<const RawPolyline*>> known;
+    known.reserve(raw_sketch.size());
+
+    size_t count = 0;
+    for (const auto& raw : raw_sketch) {
+        if (raw.isEmpty() || removed.contains(&raw)) {
+            continue;
+        }
+        auto& same_hash = known[HashPolyline(raw)];
+        if (std::any_of(same_hash.begin(), same_hash.end(),
+                        [&raw](const RawPolyline* other) { return IsSamePolyline(raw, *other); })) {
+            removed.insert(&raw);
+            ++count;
+        }
+        else {
+            same_hash.push_back(&raw);
+        }
+    }
+    return count;
+}
+
+} // namespace
+
+size_t HashPolyline(const RawPolyline& raw, Point origin) {
+    size_t hash = std::hash<int>{}(static_cast<int>(raw.orientation));
+    auto combine = [&hash](double value) {
+        hash ^= std::hash<std::uint64_t>{}(std::bit_cast<std::uint64_t>(value)) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    };
+    // Координаты округляются, чтобы хеш не зависел от погрешности вычитания 'origin'
+    auto add = [&combine, &origin](const Point& point) {
+        combine(std::round((point.x - origin.x) / HashPrecision) * HashPrecision);
+        combine(std::round((point.y - origin.y) / HashPrecision) * HashPrecision);
+    };
+
+    if (IsReversedCanonical(raw.polyline)) {
+        std::for_each(raw.polyline.rbegin(), raw.polyline.rend(), add);
+    }
+    else {
+        std::for_each(raw.polyline.begin(), raw.polyline.end(), add);
+    }
+    return hash;
+}
+
+CleanupReport CleanupRawSketch(RawData& raw_sketch, double tolerance) {
+    const StageTimer timer("cleanup");
+    CleanupReport report;
+    std::unordered_set<const RawPolyline*> removed;
+
+    // Копии удаляются до сварки: иначе копия, совпадающая концами с оригиналом, продолжала бы его
+    report.removed_duplicates = FindDuplicates(raw_sketch, removed);
+
+    std::vector<RawPolyline*> open_polylines;
+    for (auto& raw : raw_sketch) {
+        if (raw.pointsCount() >= 2 && !removed.contains(&raw) && !IsClosedOutline(raw.polyline)) {
+            open_polylines.push_back(&raw);
+        }
+    }
+
+    if (tolerance > 0. && !open_polylines.empty()) {
+        std::vector<std::optional<size_t>> partners;
+        report.welded_endpoints = WeldEndpoints(open_polylines, tolerance, partners);
+        report.joined_polylines = JoinChains(open_polylines, partners, removed);
+
+        // Сварка концов может превратить почти совпадающие ломаные в точные копии
+        if (report.welded_endpoints != 0) {
+            report.removed_duplicates += FindDuplicates(raw_sketch, removed);
+        }
+    }
+
+    raw_sketch.remove_if([&removed](const RawPolyline& raw) { return removed.contains(&raw); });
+    return report;
+}
+
+} // namespace domain
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+
+#include "common.h"
+
+namespace domain {
+
+// Итог очистки "сырого" эскиза
+struct CleanupReport {
+    size_t welded_endpoints = 0;    // Концы ломаных, перемещенные в общую точку
+    size_t joined_polylines = 0;    // Ломаные, присоединенные к продолжаемым ими
+    size_t removed_duplicates = 0;  // Удаленные точные копии ломаных
+
+    bool isEmpty() const noexcept {
+        return welded_endpoints == 0 && joined_polylines == 0 && removed_duplicates == 0;
+    }
+};
+
+// Допуск совпадения концов ломаных по умолчанию, мм
+constexpr double DefaultWeldTolerance = 1e-2;
+
+// Очищает "сырой" эскиз перед преобразованием:
+// - концы ломаных, попарно отстоящие не больше чем на 'tolerance', сводятся в одну точку;
+//   каждый конец смещается не больше чем на 'tolerance';
+// - ломаные одного направления укладки, продолжающие друг друга, объединяются
+//   (если в точке сходятся ровно два конца, иначе стык неоднозначен); замкнутые цепочки
+//   ломаных не объединяются и остаются отдельными слоями;
+// - точные копии ломаных (в том числе с обратным порядком точек) удаляются.
+// Замкнутые контуры (заполнители) не изменяются. Концы ищутся в хеш-сетке с шагом 'tolerance',
+// время работы близко к линейному по числу точек
+CleanupReport CleanupRawSketch(RawData& raw_sketch, double tolerance = DefaultWeldTolerance);
+
+// Шаг округления координат при вычислении хеша ломаной, мм
+constexpr double HashPrecision = 1e-6;
+
+// Хеш ломаной по направлению укладки и координатам точек относительно 'origin',
+// округленным с шагом HashPrecision. Не зависит от порядка обхода точек:
+// ломаные с обратным порядком точек имеют одинаковый хеш
+size_t HashPolyline(const RawPolyline& raw, Point origin = {});
+
+} // namespace domain
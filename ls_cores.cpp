@@ -0,0 +1,286 @@
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+#include "ls_cores.h"
+#include "timing.h"
+
+namespace domain {
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+using IndexPoint = bg::model::point<double, 2, bg::cs::cartesian>;
+using IndexSegment = bg::model::segment<IndexPoint>;
+using IndexPolygon = bg::model::polygon<IndexPoint>;
+using IndexMultiPolygon = bg::model::multi_polygon<IndexPolygon>;
+using IndexLinestring = bg::model::linestring<IndexPoint>;
+using IndexBox = bg::model::box<IndexPoint>;
+
+namespace {
+
+// Отрезок слоя и узел его начала
+using SegmentValue = std::pair<IndexSegment, ls::NodePosition>;
+using SegmentsIndex = bgi::rtree<SegmentValue, bgi::rstar<16>>;
+
+// Точность совпадения концов контура, как при удалении лишних точек при импорте
+constexpr double ClosingEpsilon = 1e-3;
+
+double SignedArea(const Polyline& polyline) {
+    double area = 0.;
+    for (size_t i = 0, j = polyline.size() - 1; i < polyline.size(); j = i++) {
+        area += polyline[j].x * polyline[i].y - polyline[i].x * polyline[j].y;
+    }
+    return area / 2.;
+}
+
+IndexPolygon ToIndex(const std::vector<Point>& points) {
+    IndexPolygon result;
+    for (const auto& point : points) {
+        bg::append(result.outer(), IndexPoint(point.x, point.y));
+    }
+    bg::correct(result);
+    return result;
+}
+
+Polygon FromIndex(const IndexPolygon& polygon) {
+    Polygon result;
+    const auto& ring = polygon.outer();
+    // Замыкающая точка кольца не хранится
+    for (size_t i = 0; i + 1 < ring.size(); ++i) {
+        result.addPoint({ bg::get<0>(ring[i]), bg::get<1>(ring[i]) });
+    }
+    return result;
+}
+
+Point Interpolate(const Point& a, const Point& b, double t) {
+    return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+}
+
+// R-дерево отрезков всех слоев, время O(n log n) по числу отрезков
+SegmentsIndex BuildSegmentsIndex(const ls::LaminateData& layers) {
+    std::vector<SegmentValue> segments;
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            for (size_t i = 1; i < ply.size(); ++i) {
+                segments.emplace_back(IndexSegment({ ply[i - 1].point.x, ply[i - 1].point.y },
+                                                   { ply[i].point.x, ply[i].point.y }),
+                                      ply[i - 1].position);
+            }
+        }
+    }
+    return SegmentsIndex(segments.begin(), segments.end());
+}
+
+// Вырезает из заполнителя полосы шириной 2 * clearance вокруг отрезков слоев, проходящих
+// рядом с ним. Соседние слои могут оказаться внутри контура, если привязка вершин не повторяет
+// его форму; линии слоев, на которых лежит контур, отстоят от него на отступ больше clearance
+IndexMultiPolygon ClipByPlies(IndexMultiPolygon&& core, const SegmentsIndex& segments, double clearance) {
+    IndexBox box;
+    bg::envelope(core, box);
+    bg::set<bg::min_corner, 0>(box, bg::get<bg::min_corner, 0>(box) - clearance);
+    bg::set<bg::min_corner, 1>(box, bg::get<bg::min_corner, 1>(box) - clearance);
+    bg::set<bg::max_corner, 0>(box, bg::get<bg::max_corner, 0>(box) + clearance);
+    bg::set<bg::max_corner, 1>(box, bg::get<bg::max_corner, 1>(box) + clearance);
+
+    bg::model::multi_linestring<IndexLinestring> lines;
+    for (auto it = segments.qbegin(bgi::intersects(box)); it != segments.qend(); ++it) {
+        lines.push_back(IndexLinestring{ it->first.first, it->first.second });
+    }
+    if (lines.empty()) {
+        return std::move(core);
+    }
+
+    IndexMultiPolygon bands;
+    bg::buffer(lines, bands,
+               bg::strategy::buffer::distance_symmetric<double>(clearance),
+               bg::strategy::buffer::side_straight(),
+               bg::strategy::buffer::join_miter(),
+               bg::strategy::buffer::end_flat(),
+               bg::strategy::buffer::point_square());
+
+    IndexMultiPolygon result;
+    bg::difference(core, bands, result);
+    return result;
+}
+
+} // namespace
+
+bool IsClosedOutline(const Polyline& polyline) {
+    return polyline.size() >= 4
+           && DistanceBetweenPoints(polyline.front(), polyline.back()) < ClosingEpsilon
+           && std::abs(SignedArea(polyline)) > ClosingEpsilon * ClosingEpsilon;
+}
+
+std::vector<Polygon> ExtractCores(RawData& raw_sketch) {
+    const StageTimer timer("cores");
+    std::vector<Polygon> result;
+
+    for (auto it = raw_sketch.begin(); it != raw_sketch.end();) {
+        if (!IsClosedOutline(it->polyline)) {
+            ++it;
+            continue;
+        }
+        it->polyline.pop_back();
+        result.emplace_back().addPolyline(std::move(it->polyline));
+        it = raw_sketch.erase(it);
+    }
+    return result;
+}
+
+std::vector<CoreAnchors> AnchorCores(const ls::LaminateData& layers, const std::vector<Polygon>& cores) {
+    std::vector<CoreAnchors> result;
+    if (cores.empty()) {
+        return result;
+    }
+
+    const SegmentsIndex tree = BuildSegmentsIndex(layers);
+
+    result.reserve(cores.size());
+    for (const auto& core : cores) {
+        auto& anchors = result.emplace_back();
+        anchors.reserve(core.pointsCount());
+
+        for (const auto& point : core.points()) {
+            std::vector<SegmentValue> nearest;
+            tree.query(bgi::nearest(IndexPoint(point.x, point.y), 1), std::back_inserter(nearest));
+            if (nearest.empty()) {
+                continue;
+            }
+
+            const Point a = layers.getNode(nearest.front().second).point;
+            ls::NodePosition end = nearest.front().second;
+            ++end.nodePos;
+            const Point b = layers.getNode(end).point;
+
+            // Проекция вершины на отрезок
+            const double dx = b.x - a.x;
+            const double dy = b.y - a.y;
+            const double length = dx * dx + dy * dy;
+            const double t = (length > 0.) ? ((point.x - a.x) * dx + (point.y - a.y) * dy) / length : 0.;
+
+            anchors.push_back(CoreVertexAnchor{ .start = nearest.front().second, .t = std::clamp(t, 0., 1.) });
+        }
+    }
+    return result;
+}
+
+std::vector<double> GetCoreSteps(const ls::LaminateData& layers, const std::vector<ls::Column>& columns,
+                                 const std::vector<CoreAnchors>& anchors) {
+    std::vector<double> result;
+    if (anchors.empty()) {
+        return result;
+    }
+
+    // Колонка каждого узла; узлы вне колонок не ограничивают сжатие
+    constexpr size_t NoColumn = std::numeric_limits<size_t>::max();
+    std::vector<std::vector<std::vector<size_t>>> column_of;
+    column_of.reserve(layers.layersCount());
+    for (const auto& layer : layers) {
+        auto& layer_columns = column_of.emplace_back();
+        for (const auto& ply : layer) {
+            layer_columns.emplace_back(ply.pointsCount(), NoColumn);
+        }
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        for (const auto pos : columns[i]) {
+            column_of[pos.layerPos][pos.plyPos][pos.nodePos] = i;
+        }
+    }
+
+    result.assign(columns.size(), 0.);
+    for (const auto& core : anchors) {
+        size_t first = NoColumn;
+        size_t last = 0;
+        double bottom = std::numeric_limits<double>::max();
+        double top = std::numeric_limits<double>::lowest();
+
+        for (const auto& anchor : core) {
+            ls::NodePosition next = anchor.start;
+            ++next.nodePos;
+            const double y = Interpolate(layers.getNode(anchor.start).point, layers.getNode(next).point, anchor.t).y;
+            bottom = std::min(bottom, y);
+            top = std::max(top, y);
+
+            // Вершина в узле отрезка касается только колонки этого узла
+            auto touch = [&](ls::NodePosition pos) {
+                const size_t column = column_of[pos.layerPos][pos.plyPos][pos.nodePos];
+                if (column != NoColumn) {
+                    first = std::min(first, column);
+                    last = std::max(last, column);
+                }
+            };
+            if (anchor.t < 1.) {
+                touch(anchor.start);
+            }
+            if (anchor.t > 0.) {
+                touch(next);
+            }
+        }
+        if (first == NoColumn || first >= last || !(top > bottom)) {
+            continue;
+        }
+
+        const double step = (top - bottom) / static_cast<double>(last - first);
+        for (size_t i = first + 1; i <= last; ++i) {
+            result[i] = std::max(result[i], step);
+        }
+    }
+    return result;
+}
+
+std::vector<Polygon> PlaceCores(const ls::LaminateData& layers, const std::vector<CoreAnchors>& anchors, double inset) {
+    std::vector<Polygon> result;
+    if (anchors.empty()) {
+        return result;
+    }
+
+    // Индекс нужен только для вырезания линий слоев, которое выполняется при положительном отступе
+    const SegmentsIndex segments = (inset > 0.) ? BuildSegmentsIndex(layers) : SegmentsIndex{};
+
+    const bg::strategy::buffer::distance_symmetric<double> distance(-inset);
+    const bg::strategy::buffer::side_straight side;
+    const bg::strategy::buffer::join_miter join;
+    const bg::strategy::buffer::end_flat end;
+    const bg::strategy::buffer::point_square point;
+
+    for (const auto& core : anchors) {
+        std::vector<Point> points;
+        points.reserve(core.size());
+        for (const auto& anchor : core) {
+            ls::NodePosition next = anchor.start;
+            ++next.nodePos;
+            points.push_back(Interpolate(layers.getNode(anchor.start).point, layers.getNode(next).point, anchor.t));
+        }
+        if (points.size() < 3) {
+            continue;
+        }
+
+        const IndexPolygon outline = ToIndex(points);
+        // Заполнитель, вырожденный после сжатия, не отображается
+        if (std::abs(bg::area(outline)) < inset * inset) {
+            continue;
+        }
+        if (inset <= 0. || !bg::is_valid(outline)) {
+            result.push_back(FromIndex(outline));
+            continue;
+        }
+
+        IndexMultiPolygon inner;
+        bg::buffer(outline, inner, distance, side, join, end, point);
+        if (inner.empty()) {
+            inner.push_back(outline);
+        }
+        for (const auto& polygon : ClipByPlies(std::move(inner), segments, inset / 2.)) {
+            result.push_back(FromIndex(polygon));
+        }
+    }
+    return result;
+}
+
+} // namespace domain
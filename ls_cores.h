@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "common.h"
+#include "ls_data.h"
+
+namespace domain {
+
+// Привязка вершины контура заполнителя к ближайшему отрезку слоя:
+// узел начала отрезка и доля длины отрезка от этого узла
+struct CoreVertexAnchor {
+    ls::NodePosition start;
+    double t = 0.;
+};
+
+using CoreAnchors = std::vector<CoreVertexAnchor>;
+
+// Признак замкнутого контура: первая и последняя точки совпадают, контур имеет площадь
+bool IsClosedOutline(const Polyline& polyline);
+
+// Извлекает из "сырого" эскиза замкнутые контуры заполнителей (сотовых, пенных),
+// оставляя в эскизе только линии слоев
+std::vector<Polygon> ExtractCores(RawData& raw_sketch);
+
+// Привязывает вершины контуров к ближайшим отрезкам слоев.
+// Отрезки загружаются в R-дерево, время O((n + m) log n) по числу отрезков n и вершин m
+std::vector<CoreAnchors> AnchorCores(const ls::LaminateData& layers, const std::vector<Polygon>& cores);
+
+// Наименьшие расстояния между соседними колонками, при которых сжатие оставляет ширину каждого
+// заполнителя не меньше его высоты. Элемент i относится к паре колонок i - 1 и i, ноль - пара
+// не ограничена. Заполнитель касается колонок, в которые входят концы привязанных отрезков
+// (вершина, привязанная к узлу, - только колонки этого узла);
+// высота заполнителя по привязкам в 'layers' делится поровну между парами от первой до последней
+// такой колонки. Заполнитель, касающийся меньше чем двух колонок, сжатие не ограничивает.
+// Пустой результат - ограничений нет. Время O(N + m) по числу узлов N и вершин контуров m
+std::vector<double> GetCoreSteps(const ls::LaminateData& layers, const std::vector<ls::Column>& columns,
+                                 const std::vector<CoreAnchors>& anchors);
+
+// Размещает контуры заполнителей в оптимизированном эскизе. Каждая вершина ставится на ту же
+// долю привязанного отрезка слоя, поэтому контур следует за слоями; ширину заполнителя при сжатии
+// сохраняет GetCoreSteps. Затем контур отступает внутрь на 'inset', и из него вырезаются полосы
+// шириной inset вокруг линий других слоев, попавших в контур (например, при сжатии участка
+// с локальными параметрами), так что штриховка не перекрывает слои.
+// Контуры меньше чем из трех вершин и контуры с площадью меньше inset² (вырожденные после
+// сжатия) пропускаются. При inset <= 0 и при самопересечении контур возвращается без отступа
+// и без вырезания, при толщине меньше двух отступов - без отступа. Отступ и вырезание могут
+// разделить контур на несколько или удалить его целиком, поэтому результатов может быть
+// больше или меньше, чем заполнителей.
+// Построение индекса отрезков - O(n log n) по числу отрезков слоев. Отступ и вырезание
+// выполняются операциями Boost.Geometry над многоугольниками, их время не линейно и растет
+// с числом вершин контура и пересекающих его отрезков
+std::vector<Polygon> PlaceCores(const ls::LaminateData& layers, const std::vector<CoreAnchors>& anchors, double inset);
+
+} // namespace domain
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "common.h"
+#include "counters.h"
 
 namespace ls {  // laminate sketch
 
@@ -58,6 +59,7 @@ protected:
 
 struct Ply : VectorWrapper<Node> {
     domain::Orientation orientation = domain::Orientation::Zero;
+    domain::PlyMetaId meta = domain::NoPlyMeta;    // Данные исходного слоя, одни на весь сегмент
 
     template <typename NodeT>
     Node& addNode(NodeT&& node) {
@@ -106,6 +108,17 @@ struct Layer : VectorWrapper<Ply> {
     size_t pliesCount() const noexcept { return data_.size(); }
 };
 
+// Колонка эскиза - цепочка связанных узлов снизу вверх
+using Column = std::vector<NodePosition>;
+
+// Независимое сечение эскиза: индекс его первой колонки и узлы, не вошедшие ни в одну колонку.
+// Колонки сечения идут подряд до первой колонки следующего сечения
+struct Section {
+    size_t firstColumn = 0;
+    std::vector<NodePosition> fixedNodes;
+    domain::Point origin;   // Смещение узлов сечения в координаты исходного файла
+};
+
 class LaminateData {
     void updatePositionsAfterInsertion(NodePosition pos) {
         auto& ply = getLayer(pos.layerPos).getPly(pos.plyPos);
@@ -151,6 +164,7 @@ public:
     }
 
     std::vector<Layer>& getData() { return layers_; }
+    const std::vector<Layer>& getData() const { return layers_; }
 
     void reserveLayers(size_t size) { layers_.reserve(size); }
     size_t layersCount() const noexcept { return layers_.size(); }
@@ -168,6 +182,7 @@ public:
     }
 
     Node& insertNode(const NodePosition pos, Node&& node) {
+        domain::Count(domain::Counter::NodeInsertions);
         Ply& ply = getLayer(pos.layerPos).getPly(pos.plyPos);
 
         Node& newNode = ply.insertNode(pos.nodePos, std::move(node));
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+#include "ls_diff.h"
+
+namespace domain {
+
+namespace {
+
+// Число точек, равномерно расставленных по длине слоя для сравнения линий
+constexpr size_t SamplesCount = 16;
+
+using CellKey = std::pair<std::int64_t, std::int64_t>;
+
+struct CellHash {
+    size_t operator()(const CellKey& key) const noexcept {
+        return std::hash<std::int64_t>{}(key.first * 73856093 ^ key.second * 19349663);
+    }
+};
+
+struct PlySamples {
+    PlyPosition position;
+    Orientation orientation = Orientation::NoOrientation;
+    Point center;
+    std::array<Point, SamplesCount> points;
+};
+
+std::array<Point, SamplesCount> Resample(const ls::Ply& ply) {
+    std::vector<double> lengths(ply.pointsCount(), 0.);
+    for (size_t i = 1; i < ply.pointsCount(); ++i) {
+        lengths[i] = lengths[i - 1] + DistanceBetweenPoints(ply[i - 1].point, ply[i].point);
+    }
+
+    std::array<Point, SamplesCount> result;
+    if (ply.pointsCount() < 2) {
+        result.fill(ply[0].point);
+        return result;
+    }
+
+    size_t segment = 1;
+    for (size_t k = 0; k < SamplesCount; ++k) {
+        const double target = lengths.back() * static_cast<double>(k) / static_cast<double>(SamplesCount - 1);
+        while (segment + 1 < lengths.size() && lengths[segment] < target) {
+            ++segment;
+        }
+        const Point& a = ply[segment - 1].point;
+        const Point& b = ply[segment].point;
+        const double length = lengths[segment] - lengths[segment - 1];
+        const double t = (length > 0.) ? std::clamp((target - lengths[segment - 1]) / length, 0., 1.) : 0.;
+        result[k] = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+    }
+    return result;
+}
+
+std::vector<PlySamples> SamplePlies(const ls::LaminateData& layers) {
+    std::vector<PlySamples> result;
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            if (ply.pointsCount() == 0) {
+                continue;
+            }
+            auto& samples = result.emplace_back(PlySamples{
+                .position = { .layerPos = ply[0].position.layerPos, .plyPos = ply[0].position.plyPos },
+                .orientation = ply.orientation,
+                .points = Resample(ply)
+            });
+            for (const auto& point : samples.points) {
+                samples.center.x += point.x / static_cast<double>(SamplesCount);
+                samples.center.y += point.y / static_cast<double>(SamplesCount);
+            }
+        }
+    }
+    return result;
+}
+
+// Наибольшее расстояние между соответствующими точками слоев. Направление обхода слоя не учитывается
+double Deviation(const PlySamples& lhs, const PlySamples& rhs) {
+    double forward = 0.;
+    double backward = 0.;
+    for (size_t k = 0; k < SamplesCount; ++k) {
+        forward = std::max(forward, DistanceBetweenPoints(lhs.points[k], rhs.points[k]));
+        backward = std::max(backward, DistanceBetweenPoints(lhs.points[k], rhs.points[SamplesCount - 1 - k]));
+    }
+    return std::min(forward, backward);
+}
+
+// Хеш-сетка точек с поиском ближайшей
+template <typename Value>
+class PointGrid {
+public:
+    // Шаг сетки должен быть конечным и положительным: иначе номера ячеек не определены
+    explicit PointGrid(double cell)
+        : cell_(cell)
+    {
+        assert(cell > 0. && std::isfinite(cell) && "Grid cell must be positive and finite");
+    }
+
+    CellKey cellOf(const Point& point) const {
+        return { static_cast<std::int64_t>(std::floor(point.x / cell_)),
+                 static_cast<std::int64_t>(std::floor(point.y / cell_)) };
+    }
+
+    void insert(const Point& point, Value value) {
+        const CellKey key = cellOf(point);
+        min_ = { std::min(min_.first, key.first), std::min(min_.second, key.second) };
+        max_ = { std::max(max_.first, key.first), std::max(max_.second, key.second) };
+        cells_[key].emplace_back(point, value);
+    }
+
+    // Вызывает 'visit' для всех точек в соседних с 'point' ячейках
+    template <typename Visitor>
+    void forNeighbours(const Point& point, Visitor&& visit) const {
+        const auto [cx, cy] = cellOf(point);
+        for (std::int64_t dx = -1; dx <= 1; ++dx) {
+            for (std::int64_t dy = -1; dy <= 1; ++dy) {
+                visitCell({ cx + dx, cy + dy }, visit);
+            }
+        }
+    }
+
+    // Ближайшая к 'point' точка. Ячейки просматриваются кольцами, пока кольцо может содержать более близкую точку
+    std::optional<Value> nearest(const Point& point) const {
+        if (cells_.empty()) {
+            return std::nullopt;
+        }
+        const auto [cx, cy] = cellOf(point);
+        const std::int64_t max_ring = std::max({ std::abs(cx - min_.first), std::abs(cx - max_.first),
+                                                 std::abs(cy - min_.second), std::abs(cy - max_.second) });
+
+        std::optional<Value> result;
+        double best = std::numeric_limits<double>::max();
+        auto visit = [&](const Point& candidate, const Value& value) {
+            const double distance = DistanceBetweenPoints(point, candidate);
+            if (distance < best) {
+                best = distance;
+                result = value;
+            }
+        };
+
+        for (std::int64_t ring = 0; ring <= max_ring; ++ring) {
+            if (result.has_value() && static_cast<double>(ring - 1) * cell_ > best) {
+                break;
+            }
+            for (std::int64_t dx = -ring; dx <= ring; ++dx) {
+                const bool is_edge = (dx == -ring || dx == ring);
+                for (std::int64_t dy = -ring; dy <= ring; dy += is_edge ? 1 : 2 * ring) {
+                    visitCell({ cx + dx, cy + dy }, visit);
+                    if (ring == 0) {
+                        break;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+    template <typename Visitor>
+    void visitCell(const CellKey& key, Visitor& visit) const {
+        const auto it = cells_.find(key);
+        if (it == cells_.end()) {
+            return;
+        }
+        for (const auto& [point, value] : it->second) {
+            visit(point, value);
+        }
+    }
+
+    double cell_;
+    CellKey min_{ std::numeric_limits<std::int64_t>::max(), std::numeric_limits<std::int64_t>::max() };
+    CellKey max_{ std::numeric_limits<std::int64_t>::lowest(), std::numeric_limits<std::int64_t>::lowest() };
+    std::unordered_map<CellKey, std::vector<std::pair<Point, Value>>, CellHash> cells_;
+};
+
+} // namespace
+
+SketchDiff DiffSketches(const ls::LaminateData& before, const ls::LaminateData& after,
+                        double tolerance, double match_radius) {
+    const auto before_plies = SamplePlies(before);
+    const auto after_plies = SamplePlies(after);
+
+    // Отклонение не меньше расстояния между центрами, поэтому пары с отклонением
+    // до 'match_radius' находятся в соседних ячейках
+    PointGrid<size_t> centers(match_radius);
+    for (size_t i = 0; i < before_plies.size(); ++i) {
+        centers.insert(before_plies[i].center, i);
+    }
+
+    struct Candidate {
+        double deviation;
+        size_t before;
+        size_t after;
+    };
+    std::vector<Candidate> candidates;
+
+    for (size_t i = 0; i < after_plies.size(); ++i) {
+        const PlySamples& ply = after_plies[i];
+        centers.forNeighbours(ply.center, [&](const Point&, size_t other) {
+            if (before_plies[other].orientation != ply.orientation) {
+                return;
+            }
+            const double deviation = Deviation(before_plies[other], ply);
+            if (deviation <= match_radius) {
+                candidates.push_back({ .deviation = deviation, .before = other, .after = i });
+            }
+        });
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.deviation < rhs.deviation;
+    });
+
+    std::vector<std::optional<size_t>> match_of_after(after_plies.size());
+    std::vector<bool> is_matched_before(before_plies.size(), false);
+    std::vector<double> deviations(after_plies.size(), 0.);
+
+    for (const auto& candidate : candidates) {
+        if (is_matched_before[candidate.before] || match_of_after[candidate.after].has_value()) {
+            continue;
+        }
+        is_matched_before[candidate.before] = true;
+        match_of_after[candidate.after] = candidate.before;
+        deviations[candidate.after] = candidate.deviation;
+    }
+
+    SketchDiff result;
+
+    for (size_t i = 0; i < after_plies.size(); ++i) {
+        if (!match_of_after[i].has_value()) {
+            result.push_back({ .kind = PlyChangeKind::Added, .after = after_plies[i].position });
+        }
+        else if (deviations[i] > tolerance) {
+            result.push_back({ .kind = PlyChangeKind::Modified,
+                               .before = before_plies[*match_of_after[i]].position,
+                               .after = after_plies[i].position,
+                               .deviation = deviations[i] });
+        }
+    }
+
+    PointGrid<ls::NodePosition> nodes(match_radius);
+    bool is_nodes_indexed = false;
+    for (size_t i = 0; i < before_plies.size(); ++i) {
+        if (is_matched_before[i]) {
+            continue;
+        }
+        if (!is_nodes_indexed) {
+            // Узлы новой редакции индексируются, только если есть удаленные слои
+            is_nodes_indexed = true;
+            for (const auto& layer : after) {
+                for (const auto& ply : layer) {
+                    for (const auto& node : ply) {
+                        nodes.insert(node.point, node.position);
+                    }
+                }
+            }
+        }
+        result.push_back({ .kind = PlyChangeKind::Removed,
+                           .before = before_plies[i].position,
+                           .anchor = nodes.nearest(before_plies[i].center) });
+    }
+    return result;
+}
+
+} // namespace domain
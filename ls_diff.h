@@ -0,0 +1,47 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include "ls_data.h"
+
+namespace domain {
+
+enum class PlyChangeKind {
+    Added,      // Слой есть только в новой редакции
+    Removed,    // Слой есть только в прежней редакции
+    Modified    // Слой есть в обеих редакциях, но его линия сместилась или изменилась
+};
+
+struct PlyPosition {
+    unsigned short layerPos = 0;
+    unsigned short plyPos = 0;
+};
+
+struct PlyChange {
+    PlyChangeKind kind = PlyChangeKind::Modified;
+    std::optional<PlyPosition> before;      // Слой прежней редакции (кроме добавленных)
+    std::optional<PlyPosition> after;       // Слой новой редакции (кроме удаленных)
+    double deviation = 0.;                  // Наибольшее отклонение линии измененного слоя, мм
+    std::optional<ls::NodePosition> anchor; // Для удаленного слоя - ближайший к нему узел новой редакции
+};
+
+using SketchDiff = std::vector<PlyChange>;
+
+// Изменение для отображения: линия слоя в координатах эскиза. Удаленный слой
+// отображается одной точкой - положением ближайшего к нему узла новой редакции
+struct DiffHighlight {
+    PlyChangeKind kind = PlyChangeKind::Modified;
+    Polyline polyline;
+};
+
+// Сравнивает две редакции преобразованного эскиза. Слои сопоставляются по направлению укладки
+// и геометрии: кандидаты ищутся в хеш-сетке с шагом 'match_radius' по центрам слоев,
+// отклонение пары - наибольшее расстояние между равномерно расставленными по длине точками слоев.
+// Пары назначаются в порядке возрастания отклонения, пары с отклонением до 'tolerance'
+// считаются неизмененными. Несопоставленные слои - добавленные или удаленные.
+// 'match_radius' - конечное положительное число, не меньше 'tolerance'
+SketchDiff DiffSketches(const ls::LaminateData& before, const ls::LaminateData& after,
+                        double tolerance, double match_radius);
+
+} // namespace domain
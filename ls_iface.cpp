@@ -1,44 +1,88 @@
 
 
+#include <chrono>
+#include <cmath>
 #include <limits>
 #include <numeric>
+#include <tuple>
 
 #include "ls_iface.h"
+#include "counters.h"
+#include "parallel.h"
+#include "timing.h"
 
 namespace domain {
 
-// Определяет является ли ломаная линия верхним слоем (сегментом слоя)
-bool IsUpperPolyline(const Polyline& input, const RawData& raw_sketch) {
+// Пробная геометрия ломаной линии: смещенная вверх копия и многоугольник между ними.
+// Зависит только от самой линии, поэтому вычисляется один раз и используется
+// во всех раундах выделения верхних слоев, пока линия не будет удалена из эскиза
+struct PlyProbe {
+    RawData::iterator ply;
+    Point offset_begin;     // Начальная и конечная точки смещенной линии
+    Point offset_end;
+    Polygon polygon;
+    double seconds = 0.;    // Время построения и проверок ломаной
+};
+
+using PlyProbes = std::list<PlyProbe>;
+
+PlyProbe MakePlyProbe(RawData::iterator ply) {
+    const auto& input = ply->polyline;
+
     // Смещаем проверяемую линию вверх и убираем самопересечения
     auto offset = RemoveSelfIntersections(OffsetPolyline(input, 3.));  // Смещение на 3 достаточно для всех случаев
     // не существует слоистых материалов с толщиной монослоя более 3
 
+    PlyProbe result{ .ply = ply };
+    result.offset_begin = offset.empty() ? input.front() : offset.front();
+    result.offset_end = offset.empty() ? input.back() : offset.back();
+
+    // Создаем многоугольник разворачивая точки offset
+    // и добавляя эти ломаные в многоугольник
+    std::reverse(offset.begin(), offset.end());
+    result.polygon.addPolyline(input);
+    result.polygon.addPolyline(std::move(offset));
+
+    return result;
+}
+
+// Строит пробные геометрии ломаных. По запросу остановки или истечении времени
+// возвращает геометрии только части ломаных
+PlyProbes MakePlyProbes(RawData& raw_sketch, const Progress& progress) {
+    const StageTimer timer("probes");
+    PlyProbes result;
+    for (auto it = raw_sketch.begin(); it != raw_sketch.end() && !progress.shouldStop(); ++it) {
+        const auto start = Progress::Clock::now();
+        result.push_back(MakePlyProbe(it));
+        result.back().seconds = std::chrono::duration<double>(Progress::Clock::now() - start).count();
+        progress.advance(1);
+    }
+    return result;
+}
+
+// Определяет является ли ломаная линия верхним слоем (сегментом слоя)
+bool IsUpperPolyline(const PlyProbe& probe, const RawData& raw_sketch) {
+    Count(Counter::UpperPlyChecks);
+    const auto& input = probe.ply->polyline;
+
     // Проверка пересечения остальных линий эскиза с линиями соединяющими
-    // начальные и конечные точки 'input' и 'offset'
+    // начальные и конечные точки 'input' и смещенной линии
     for (const auto& layer : raw_sketch) {
         if (&input == &layer.polyline) {
             continue;  // Пропускаем проверяемую линию
         }
-        if (IsLineIntersectsPolyline(*input.begin(), *offset.begin(), layer.polyline)
-            || IsLineIntersectsPolyline(input.back(), offset.back(), layer.polyline))
+        if (IsLineIntersectsPolyline(input.front(), probe.offset_begin, layer.polyline)
+            || IsLineIntersectsPolyline(input.back(), probe.offset_end, layer.polyline))
         {
             return false;
         }
     }
 
-    // Создаем многоугольник разворачивая точки offset
-    // и добавляя эти ломаные в многоугольник
-
-    std::reverse(offset.begin(), offset.end());
-    Polygon polygon;
-    polygon.addPolyline(input);
-    polygon.addPolyline(std::move(offset));
-
     for (const auto& layer : raw_sketch) {
         if (&input == &layer.polyline) {
             continue;  // Пропускаем проверяемую линию
         }
-        if (IsPolylinePointInPolygon(layer.polyline, polygon))
+        if (IsPolylinePointInPolygon(layer.polyline, probe.polygon))
         {
             return false;
         }
@@ -46,8 +90,8 @@ bool IsUpperPolyline(const Polyline& input, const RawData& raw_sketch) {
     return true;
 }
 
-// Перемещает "сырой" эскиз в начало координат (0,0)
-void MoveRawSketchToZero(RawData& raw_sketch) {
+// Перемещает "сырой" эскиз в начало координат (0,0), возвращает прежнее положение начала координат
+Point MoveRawSketchToZero(RawData& raw_sketch) {
     double left = std::numeric_limits<double>::max();
     double bottom = std::numeric_limits<double>::max();
 
@@ -64,6 +108,7 @@ void MoveRawSketchToZero(RawData& raw_sketch) {
             point.y -= bottom;
         }
     }
+    return raw_sketch.empty() ? Point{} : Point{ left, bottom };
 }
 
 // Оптимизирует линии эскиза так, чтобы точки линии шли слева направо
@@ -78,13 +123,23 @@ void StartPointOptimization(RawData& raw_sketch) {
     }
 }
 
-// Возвращает итераторы на верхние слои эскиза
-std::vector<RawData::iterator>GetUpperPlies(RawData& raw_sketch) {
-    std::vector<RawData::iterator> result;
+// Возвращает итераторы на пробные геометрии верхних слоев эскиза.
+// По запросу остановки или истечении времени возвращает пустой результат
+std::vector<PlyProbes::iterator> GetUpperPlies(PlyProbes& probes, const RawData& raw_sketch,
+                                               const Progress& progress) {
+    const StageTimer timer("upper plies");
+    std::vector<PlyProbes::iterator> result;
+
+    for (auto it = probes.begin(); it != probes.end(); ++it) {
+        if (progress.shouldStop()) {
+            return {};
+        }
 
-    for (RawData::iterator it = raw_sketch.begin(); it != raw_sketch.end(); ++it) {
+        const auto start = Progress::Clock::now();
+        const bool is_upper = IsUpperPolyline(*it, raw_sketch);
+        it->seconds += std::chrono::duration<double>(Progress::Clock::now() - start).count();
 
-        if (IsUpperPolyline(it->polyline, raw_sketch)) {
+        if (is_upper) {
             result.push_back(it);
         }
     }
@@ -97,6 +152,7 @@ std::vector<RawData::iterator>GetUpperPlies(RawData& raw_sketch) {
 std::pair<bool, bool> TryConnectIntersection(const std::optional<Point>& intersect,
                                              ls::Node& first, ls::Node& second,
                                              ls::Node& connectable_node) {
+    Count(Counter::LinkAttempts);
     if (!intersect) {
         return { false, false };
     }
@@ -116,11 +172,16 @@ std::pair<bool, bool> TryConnectIntersection(const std::optional<Point>& interse
     return { false, false };
 }
 
-// Соединяет неиспользованные точки с сегментом граниченным узлами first и last
+// Позиции узлов не связанных с другими и признак того, что узел был связан при добавлении слоя
+using UnusedNodes = std::vector<std::pair<ls::NodePosition, bool>>;
+
+// Соединяет неиспользованные точки-кандидаты с сегментом граниченным узлами first и last.
+// 'candidates' - индексы в 'unused_nodes' в порядке возрастания
 void ConnectLineWithNodes(ls::Node& first, ls::Node& second, ls::LaminateData& data,
-                          std::vector<std::pair<ls::NodePosition, bool>>& unused_nodes)
+                          UnusedNodes& unused_nodes, const std::vector<size_t>& candidates)
 {
-    for (auto& [node_pos, is_tied] : unused_nodes) {
+    for (const size_t index : candidates) {
+        auto& [node_pos, is_tied] = unused_nodes[index];
 
         ls::Node& connectable = data.getNode(node_pos);
 
@@ -217,7 +278,8 @@ void ConnectLineWithNodes(ls::Node& first, ls::Node& second, ls::LaminateData& d
     }
 }
 
-void ConnectNodes(ls::Ply& ply, ls::LaminateData& data, std::vector<std::pair<ls::NodePosition, bool>>& unused_nodes) {
+void ConnectNodes(ls::Ply& ply, ls::LaminateData& data, UnusedNodes& unused_nodes,
+                  const std::vector<size_t>& candidates) {
     // Вызов GetLastNode() необходим каждый раз, т.к. в сегмент 'ply' могут добавляться новые узлы
     for (auto pos = ply.firstNode().position; pos <= ply.lastNode().position; ++pos.nodePos) {
         if (pos.nodePos != 0) {
@@ -226,14 +288,80 @@ void ConnectNodes(ls::Ply& ply, ls::LaminateData& data, std::vector<std::pair<ls
                                                        .nodePos = static_cast<unsigned short>(pos.nodePos - 1) });
             ls::Node& second = data.getNode(pos);
 
-            ConnectLineWithNodes(first, second, data, unused_nodes);
+            ConnectLineWithNodes(first, second, data, unused_nodes, candidates);
+        }
+    }
+}
+
+// Возвращает индексы неиспользованных узлов, которые могут быть соединены с сегментом.
+// Лучи соединения (биссектриса и перпендикуляры) не длиннее 3 от узла, поэтому узлы
+// дальше этого расстояния от габарита сегмента гарантированно не соединяются
+std::vector<size_t> GetLinkCandidates(const ls::Ply& ply, const ls::LaminateData& data,
+                                      const UnusedNodes& unused_nodes) {
+    BoundingBox box;
+    for (const auto& node : ply) {
+        box.extend(node.point);
+    }
+
+    // Запас учитывает длину лучей и допуск на параметры при поиске пересечений
+    const double margin = 3.1 + 0.002 * (box.width() + box.height());
+
+    std::vector<size_t> result;
+    for (size_t i = 0; i < unused_nodes.size(); ++i) {
+        if (box.contains(data.getNode(unused_nodes[i].first).point, margin)) {
+            result.push_back(i);
         }
     }
+    return result;
 }
 
+std::vector<std::vector<size_t>> GroupConflictingPlies(const std::vector<std::vector<size_t>>& candidates,
+                                                       size_t unused_count) {
+    std::vector<size_t> parent(candidates.size());
+    std::iota(parent.begin(), parent.end(), 0);
+
+    auto find_root = [&parent](size_t ply) {
+        while (parent[ply] != ply) {
+            ply = parent[ply] = parent[parent[ply]];
+        }
+        return ply;
+    };
+
+    constexpr size_t no_owner = std::numeric_limits<size_t>::max();
+    std::vector<size_t> owner(unused_count, no_owner);
+
+    for (size_t ply = 0; ply < candidates.size(); ++ply) {
+        for (const size_t index : candidates[ply]) {
+            if (owner[index] == no_owner) {
+                owner[index] = ply;
+            }
+            else {
+                const size_t lhs = find_root(owner[index]);
+                const size_t rhs = find_root(ply);
+                parent[std::max(lhs, rhs)] = std::min(lhs, rhs);
+            }
+        }
+    }
+
+    std::vector<std::vector<size_t>> result;
+    std::vector<size_t> group_of(candidates.size());
+    for (size_t ply = 0; ply < candidates.size(); ++ply) {
+        const size_t root = find_root(ply);
+        if (root == ply) {
+            group_of[ply] = result.size();
+            result.emplace_back();
+        }
+        result[group_of[root]].push_back(ply);
+    }
+    return result;
+}
+
+// Слой добавляется целиком: прерывание внутри слоя оставило бы связи узлов незавершенными,
+// поэтому 'progress' используется только для учета выполненной работы
 void AddLayer(std::vector<RawData::iterator> upper_plies, ls::LaminateData& data,
-              std::vector<std::pair<ls::NodePosition, bool>>& unused_nodes)
+              UnusedNodes& unused_nodes, const Progress& progress, size_t threads_count = DefaultThreadsCount())
 {
+    const StageTimer timer("add layer");
     // Сортировка сегментов слева направо
     std::sort(upper_plies.begin(), upper_plies.end(),
               [](const auto& lhs, const auto& rhs) {
@@ -246,6 +374,8 @@ void AddLayer(std::vector<RawData::iterator> upper_plies, ls::LaminateData& data
 
     const bool is_first_layer = (layer_pos == 0);
 
+    std::vector<std::vector<size_t>> candidates(upper_plies.size());
+
     for (auto& ply : upper_plies) {
         const unsigned short ply_pos = data.getLayer(layer_pos).pliesCount(); // Опережающее присвоение чтобы не вычитать единицу
         auto& new_ply = new_layer.addPly();
@@ -253,7 +383,8 @@ void AddLayer(std::vector<RawData::iterator> upper_plies, ls::LaminateData& data
         const auto points_count = ply->pointsCount();
 
         new_ply.orientation = ply->orientation;
-        new_ply.reserve(is_first_layer ? points_count : points_count + unused_nodes.size());
+        new_ply.meta = ply->meta;
+        new_ply.reserve(points_count);
 
         // Добавляем узлы в сегмент
         for (unsigned short i = 0; i < points_count; ++i) {
@@ -264,12 +395,40 @@ void AddLayer(std::vector<RawData::iterator> upper_plies, ls::LaminateData& data
                         .nodePos = i}
             });
         }
-        // Соединяем узлы нового сегмента с неиспользованными узлами
+
         if (!is_first_layer) {
-            ConnectNodes(new_ply, data, unused_nodes);
+            auto& ply_candidates = candidates[ply_pos];
+            ply_candidates = GetLinkCandidates(new_ply, data, unused_nodes);
+            // Каждый кандидат добавляет в сегмент не более одного узла,
+            // резерв исключает перевыделение памяти и порчу ссылок на узлы
+            new_ply.reserve(points_count + ply_candidates.size());
         }
     }
 
+    // Соединяем узлы новых сегментов с неиспользованными узлами.
+    // Сегменты с общими кандидатами обрабатываются последовательно в порядке слева направо,
+    // независимые группы - параллельно. Результат совпадает с последовательной обработкой
+    if (!is_first_layer) {
+        const auto groups = GroupConflictingPlies(candidates, unused_nodes.size());
+
+        size_t work = 0;
+        for (unsigned short ply_pos = 0; ply_pos < new_layer.size(); ++ply_pos) {
+            work += new_layer[ply_pos].pointsCount() * candidates[ply_pos].size();
+        }
+        // Для небольших слоев запуск потоков дороже самой работы
+        constexpr size_t min_parallel_work = 20000;
+        if (work < min_parallel_work) {
+            threads_count = 1;
+        }
+
+        const StageTimer link_timer("link");
+        ParallelFor(groups.size(), [&](size_t group_index) {
+            for (const size_t ply_pos : groups[group_index]) {
+                ConnectNodes(new_layer[ply_pos], data, unused_nodes, candidates[ply_pos]);
+            }
+        }, threads_count);
+    }
+
     // Очистка от использованных узлов
     unused_nodes.erase(
         std::remove_if(unused_nodes.begin(), unused_nodes.end(),
@@ -293,10 +452,12 @@ void AddLayer(std::vector<RawData::iterator> upper_plies, ls::LaminateData& data
                 );
         }
     }
+
+    progress.advance(upper_plies.size());
 }
 
 void ReverseLayers(ls::LaminateData& data) {
-
+    const StageTimer timer("reverse");
     unsigned short correction_pos = data.layersCount() - 1;
 
     // Переворачиваем layer_pos в позиции узлов
@@ -316,29 +477,171 @@ void ReverseLayers(ls::LaminateData& data) {
     std::reverse(data.begin(), data.end());
 }
 
-ls::LaminateData ConvertRawSketch(RawData&& raw_sketch) {
+// Собирает в 'report' затраты на ломаные и оставляет самые затратные
+void CollectExpensive(std::vector<ls::PolylineCost>&& costs, ls::ConversionReport& report) {
+    const size_t count = std::min(costs.size(), ls::ConversionReport::MaxExpensive);
+    std::partial_sort(costs.begin(), costs.begin() + count, costs.end(),
+                      [](const auto& lhs, const auto& rhs) { return lhs.seconds > rhs.seconds; });
+    costs.resize(count);
+    report.expensive = std::move(costs);
+}
+
+ls::PolylineCost GetPolylineCost(const PlyProbe& probe) {
+    return ls::PolylineCost{ .first = probe.ply->polyline.front(), .last = probe.ply->polyline.back(),
+                             .points_count = probe.ply->pointsCount(), .seconds = probe.seconds };
+}
+
+// Выделяет слои эскиза сверху вниз. При запросе остановки возвращает пустой результат.
+// По истечении времени или при ошибке выделения слоя возвращает уже выделенные верхние слои,
+// состояние преобразования и самые затратные ломаные записываются в 'report'
+ls::LaminateData ConvertRawSketch(RawData&& raw_sketch, const Progress& progress, ls::ConversionReport& report,
+                                  size_t threads_count = DefaultThreadsCount()) {
     ls::LaminateData result;
     result.reserveLayers(raw_sketch.size()); // Слоев не может быть больше чем ломаных в сыром эскизе
+    report.total_polylines = raw_sketch.size();
 
     StartPointOptimization(raw_sketch);    // Переворачиваем линии эскиза если они идут справа налево
 
-    std::vector<std::pair<ls::NodePosition, bool>> unused_nodes;  // Для хранения позиций узлов не связанных с другими
+    UnusedNodes unused_nodes;  // Для хранения позиций узлов не связанных с другими
+
+    auto probes = MakePlyProbes(raw_sketch, progress);   // Пробные геометрии строятся один раз на весь процесс
 
+    std::vector<ls::PolylineCost> costs;
+    costs.reserve(raw_sketch.size());
+
+    size_t round = 0;
     while (!raw_sketch.empty()) {          // Создаем слои эскиза из линий "сырого" эскиза
 
-        auto upper_plies = GetUpperPlies(raw_sketch);
+        if (progress.shouldStop()) {
+            break;
+        }
+        const StageTimer round_timer("peel round", ++round);
+
+        auto upper_probes = GetUpperPlies(probes, raw_sketch, progress);
 
-        if (upper_plies.empty()) {          // Ошибка обработки
-            return {};
+        if (progress.shouldStop()) {       // Проверка прервана, выделенные слои не изменились
+            break;
+        }
+        if (upper_probes.empty()) {          // Ошибка обработки
+            report.status = ls::ConversionStatus::Failed;
+            break;
+        }
+
+        std::vector<RawData::iterator> upper_plies;
+        upper_plies.reserve(upper_probes.size());
+        for (const auto probe : upper_probes) {
+            upper_plies.push_back(probe->ply);
         }
 
-        AddLayer(upper_plies, result, unused_nodes);  // Добавляем слои
+        AddLayer(upper_plies, result, unused_nodes, progress, threads_count);  // Добавляем слои
 
-        for (const auto pos : upper_plies) {          // Удаляем верхние слои из сырого эскиза
-            raw_sketch.erase(pos);
+        for (const auto probe : upper_probes) {       // Удаляем верхние слои из сырого эскиза
+            costs.push_back(GetPolylineCost(*probe));
+            raw_sketch.erase(probe->ply);
+            probes.erase(probe);
         }
     }
-    ReverseLayers(result);
+
+    if (progress.isCancelled()) {
+        return {};
+    }
+    if (!raw_sketch.empty() && report.status == ls::ConversionStatus::Completed) {
+        report.status = ls::ConversionStatus::TimedOut;
+    }
+    report.remaining_polylines = raw_sketch.size();
+
+    for (const auto& probe : probes) {
+        costs.push_back(GetPolylineCost(probe));
+    }
+    CollectExpensive(std::move(costs), report);
+
+    if (!result.isEmpty()) {
+        ReverseLayers(result);
+    }
+    return result;
+}
+
+// Габарит ломаной с запасом, за пределами которого она не влияет на другие ломаные:
+// пробная геометрия смещена на 3 (MakePlyProbe), лучи соединения узлов не длиннее 3 (GetLinkCandidates)
+BoundingBox GetInfluenceBox(const Polyline& polyline) {
+    BoundingBox box;
+    for (const auto& point : polyline) {
+        box.extend(point);
+    }
+
+    const double margin = 3.1 + 0.002 * (box.width() + box.height());
+    box.left -= margin, box.right += margin;
+    box.bottom -= margin, box.top += margin;
+    return box;
+}
+
+// Разбивает "сырой" эскиз на независимые сечения - группы ломаных, связанных пересечением
+// габаритов с запасом. Ломаные разных сечений не влияют друг на друга при преобразовании.
+// Сечения упорядочены по левой границе, порядок ломаных внутри сечения сохраняется
+std::vector<RawData> SplitIntoSections(RawData&& raw_sketch) {
+    const StageTimer timer("split");
+    std::vector<RawData::iterator> plies;
+    std::vector<BoundingBox> boxes;
+    for (auto it = raw_sketch.begin(); it != raw_sketch.end(); ++it) {
+        plies.push_back(it);
+        boxes.push_back(GetInfluenceBox(it->polyline));
+    }
+
+    std::vector<size_t> parent(plies.size());
+    std::iota(parent.begin(), parent.end(), 0);
+
+    auto find_root = [&parent](size_t ply) {
+        while (parent[ply] != ply) {
+            ply = parent[ply] = parent[parent[ply]];
+        }
+        return ply;
+    };
+
+    // Проход по ломаным в порядке левых границ: пересекаться могут только
+    // габариты, левая граница которых не правее правой границы текущего
+    std::vector<size_t> order(plies.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&boxes](size_t lhs, size_t rhs) { return boxes[lhs].left < boxes[rhs].left; });
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        const auto& box = boxes[order[i]];
+        for (size_t j = i + 1; j < order.size() && boxes[order[j]].left <= box.right; ++j) {
+            if (box.intersects(boxes[order[j]])) {
+                const size_t lhs = find_root(order[i]);
+                const size_t rhs = find_root(order[j]);
+                parent[std::max(lhs, rhs)] = std::min(lhs, rhs);
+            }
+        }
+    }
+
+    std::vector<size_t> section_of(plies.size());
+    std::vector<double> lefts;
+    size_t sections_count = 0;
+    for (size_t ply = 0; ply < plies.size(); ++ply) {
+        const size_t root = find_root(ply);
+        if (root == ply) {
+            section_of[ply] = sections_count++;
+            lefts.push_back(boxes[ply].left);
+        }
+        section_of[ply] = section_of[root];
+        lefts[section_of[ply]] = std::min(lefts[section_of[ply]], boxes[ply].left);
+    }
+
+    std::vector<size_t> section_order(sections_count);
+    std::iota(section_order.begin(), section_order.end(), 0);
+    std::stable_sort(section_order.begin(), section_order.end(),
+                     [&lefts](size_t lhs, size_t rhs) { return lefts[lhs] < lefts[rhs]; });
+    std::vector<size_t> place(sections_count);
+    for (size_t i = 0; i < sections_count; ++i) {
+        place[section_order[i]] = i;
+    }
+
+    std::vector<RawData> result(sections_count);
+    for (size_t ply = 0; ply < plies.size(); ++ply) {
+        auto& section = result[place[section_of[ply]]];
+        section.splice(section.end(), raw_sketch, plies[ply]);
+    }
     return result;
 }
 
@@ -354,11 +657,11 @@ void ScaleLayers(ls::LaminateData& layers, double scale)
     }
 }
 
-std::optional<ls::NodePosition> TryGetNextPos(const ls::NodePosition pos, ls::LaminateData& layers) {
+std::optional<ls::NodePosition> TryGetNextPos(const ls::NodePosition pos, const ls::LaminateData& layers) {
     if (!layers.isLastPlyNode(pos)) {
         return layers.getLayer(pos.layerPos).getPly(pos.plyPos).getNode(pos.nodePos + 1).position;
     }
-    ls::Node& node = layers.getNode(pos);
+    const ls::Node& node = layers.getNode(pos);
     if (node.upperLink.has_value()) {
         return TryGetNextPos(node.upperLink.value(), layers);
     }
@@ -380,7 +683,7 @@ double GetMinDistanceGroupNodes(const ls::NodePosition pos, ls::LaminateData& la
 }
 
 double GetMinDistanceBetweenPlies(ls::LaminateData& layers) {
-
+    const StageTimer timer("min distance");
     double result = std::numeric_limits<double>::max();
 
     auto pos = layers.findRootNode();
@@ -398,97 +701,654 @@ double GetMinDistanceBetweenPlies(ls::LaminateData& layers) {
     return result;
 }
 
-double GetMinDistanceBetweenGroupNodes(const ls::NodePosition first, const ls::NodePosition second, ls::LaminateData& layers) {
-    ls::Node first_node = layers.getNode(first);
-    ls::Node second_node = layers.getNode(second);
+// Строит колонки эскиза в порядке обхода слева направо.
+// Колонка - цепочка связанных узлов от начального узла вверх
+std::vector<ls::Column> BuildColumns(const ls::LaminateData& layers) {
+    const StageTimer timer("columns");
+    std::vector<ls::Column> result;
+
+    auto add_column = [&](ls::NodePosition pos) {
+        auto& column = result.emplace_back();
+        column.push_back(pos);
+        while (const auto& link = layers.getNode(pos).upperLink) {
+            pos = *link;
+            column.push_back(pos);
+        }
+    };
+
+    const auto root = layers.findRootNode();
+    add_column(root);
 
-    double result = DistanceBetweenPoints(first_node.point, second_node.point);
+    auto next_pos = TryGetNextPos(root, layers);
+    if (next_pos.has_value()) {
+        add_column(next_pos.value());   // Вторая колонка начинается с соседнего узла без спуска вниз
+        while ((next_pos = TryGetNextPos(result.back().front(), layers))) {
+            add_column(layers.traceToBottom(next_pos.value()));
+        }
+    }
+    return result;
+}
 
-    while (true) {
-        if (first_node.upperLink.has_value() && second_node.upperLink.has_value()) {
-            first_node = layers.getNode(first_node.upperLink.value());
-            second_node = layers.getNode(second_node.upperLink.value());
-            result = std::min(result, DistanceBetweenPoints(first_node.point, second_node.point));
+// Узлы, не вошедшие ни в одну колонку. Такие узлы смещаются при сжатии только вместе с сечением
+std::vector<ls::NodePosition> GetFixedNodes(const ls::LaminateData& layers, const std::vector<ls::Column>& columns) {
+    const StageTimer timer("fixed nodes");
+    std::vector<std::vector<std::vector<bool>>> in_column;
+    in_column.reserve(layers.layersCount());
+    for (const auto& layer : layers) {
+        auto& layer_flags = in_column.emplace_back();
+        for (const auto& ply : layer) {
+            layer_flags.emplace_back(ply.pointsCount(), false);
         }
-        else {
-            break;
+    }
+    for (const auto& column : columns) {
+        for (const auto pos : column) {
+            in_column[pos.layerPos][pos.plyPos][pos.nodePos] = true;
+        }
+    }
+
+    std::vector<ls::NodePosition> result;
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            for (const auto& node : ply) {
+                const auto pos = node.position;
+                if (!in_column[pos.layerPos][pos.plyPos][pos.nodePos]) {
+                    result.push_back(pos);
+                }
+            }
         }
     }
+    return result;
+}
 
+double GetMinDistanceBetweenColumns(const ls::Column& first, const ls::Column& second, const ls::LaminateData& layers) {
+    double result = std::numeric_limits<double>::max();
+
+    const size_t count = std::min(first.size(), second.size());
+    for (size_t i = 0; i < count; ++i) {
+        result = std::min(result, DistanceBetweenPoints(layers.getNode(first[i]).point,
+                                                        layers.getNode(second[i]).point));
+    }
     return result;
 }
 
-void CompressPairGroupNodes(const ls::NodePosition first, const ls::NodePosition second, ls::LaminateData& layers, double max_distance) {
-    ls::Node first_node = layers.getNode(first);
-    ls::Node second_node = layers.getNode(second);
+bool IsSectionStart(const std::vector<ls::Section>& sections, size_t column) {
+    return std::ranges::binary_search(sections, column, {}, &ls::Section::firstColumn);
+}
+
+// Наибольшее расстояние между колонками 'index' - 1 и 'index' с учетом заполнителей: пару,
+// которую занимает заполнитель, сжатие не сближает больше чем до core_steps[index], см. GetCoreSteps
+double LimitByCores(const std::vector<double>& core_steps, size_t index, double max_distance) {
+    return (index < core_steps.size()) ? std::max(max_distance, core_steps[index]) : max_distance;
+}
 
-    auto mid_point = GetPointOnRay(first_node.point, second_node.point, max_distance);
-    double dx = second_node.point.x - mid_point.x;
-    double dy = second_node.point.y - mid_point.y;
+// Смещение колонки 'index' относительно предыдущей при сжатии пары до расстояния 'max_distance'.
+// Первая колонка сечения не сжимается к предыдущему сечению
+Point GetColumnStep(const ls::LaminateData& layers, const std::vector<ls::Column>& columns,
+                    const std::vector<ls::Section>& sections, size_t index, double max_distance) {
+    if (IsSectionStart(sections, index)) {
+        return {};
+    }
 
-    auto pos = second;
+    const auto& first = columns[index - 1];
+    const auto& second = columns[index];
 
-    while (true) {
-        auto temp_pos = pos;
-        while (true) {
-            ls::Node& changed_node = layers.getNode(temp_pos);
-            changed_node.point.x -= dx;
-            changed_node.point.y -= dy;
-            if (changed_node.upperLink.has_value()) {
-                temp_pos = changed_node.upperLink.value();
+    if (max_distance < GetMinDistanceBetweenColumns(first, second, layers)) {
+        const Point& first_point = layers.getNode(first.front()).point;
+        const Point& second_point = layers.getNode(second.front()).point;
+        const auto mid_point = GetPointOnRay(first_point, second_point, max_distance);
+
+        return { second_point.x - mid_point.x, second_point.y - mid_point.y };
+    }
+    return {};
+}
+
+// Вычисляет накопленные смещения колонок при сжатии эскиза.
+// Сжатие пары соседних колонок сдвигает вторую колонку и все колонки правее на одну и ту же величину,
+// поэтому расстояние внутри каждой следующей пары не меняется и все смещения вычисляются
+// по исходным координатам за один проход. 'max_distance_at(i)' - наибольшее расстояние
+// между колонками i - 1 и i. При запросе остановки или истечении времени возвращает std::nullopt
+template <typename MaxDistance>
+std::optional<std::vector<Point>> GetColumnShifts(const ls::LaminateData& layers, const std::vector<ls::Column>& columns,
+                                                  const std::vector<ls::Section>& sections,
+                                                  MaxDistance max_distance_at, const Progress& progress = {}) {
+    std::vector<Point> result(columns.size());
+
+    Point shift;
+    for (size_t i = 1; i < columns.size(); ++i) {
+        if (progress.shouldStop()) {
+            return std::nullopt;
+        }
+        progress.advance(1);
+
+        const Point step = GetColumnStep(layers, columns, sections, i, max_distance_at(i));
+        shift.x += step.x;
+        shift.y += step.y;
+        result[i] = shift;
+    }
+    return result;
+}
+
+// Сжимает эскиз и возвращает накопленные смещения колонок.
+// При запросе остановки или истечении времени возвращает std::nullopt, эскиз не изменяется
+template <typename MaxDistance>
+std::optional<std::vector<Point>> CompressSketch(ls::LaminateData& layers, const std::vector<ls::Column>& columns,
+                                                 const std::vector<ls::Section>& sections,
+                                                 MaxDistance max_distance_at, const Progress& progress = {}) {
+    const StageTimer timer("compress");
+    auto shifts = GetColumnShifts(layers, columns, sections, max_distance_at, progress);
+    if (!shifts.has_value()) {
+        return std::nullopt;
+    }
+
+    auto move_node = [&layers](ls::NodePosition pos, const Point& shift) {
+        ls::Node& changed_node = layers.getNode(pos);
+        changed_node.point.x -= shift.x;
+        changed_node.point.y -= shift.y;
+    };
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        for (const auto pos : columns[i]) {
+            move_node(pos, (*shifts)[i]);
+        }
+    }
+    for (const auto& section : sections) {
+        for (const auto pos : section.fixedNodes) {
+            move_node(pos, (*shifts)[section.firstColumn]);
+        }
+    }
+    return shifts;
+}
+
+// Габарит сжатого эскиза без копирования данных
+BoundingBox GetCompressedBox(const ls::LaminateData& layers, const std::vector<ls::Column>& columns,
+                             const std::vector<ls::Section>& sections, const std::vector<double>& core_steps,
+                             double max_distance) {
+    const auto shifts = GetColumnShifts(layers, columns, sections, [&core_steps, max_distance](size_t index) {
+                                            return LimitByCores(core_steps, index, max_distance);
+                                        }).value();
+
+    BoundingBox result;
+    auto extend = [&](ls::NodePosition pos, const Point& shift) {
+        const Point& point = layers.getNode(pos).point;
+        result.extend(Point{ point.x - shift.x, point.y - shift.y });
+    };
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        for (const auto pos : columns[i]) {
+            extend(pos, shifts[i]);
+        }
+    }
+    for (const auto& section : sections) {
+        for (const auto pos : section.fixedNodes) {
+            extend(pos, shifts[section.firstColumn]);
+        }
+    }
+    return result;
+}
+
+// Параметры колонки с учетом локальных параметров участков
+struct ColumnParams {
+    double max_distance = 0.;   // Наибольшее расстояние до предыдущей колонки до масштабирования
+    double stretch = 1.;        // Растяжение колонки по высоте относительно общего расстояния между слоями
+};
+
+std::vector<ColumnParams> GetColumnParams(size_t columns_count, const std::vector<ls::RegionParams>& regions,
+                                          const ls::OptimizationParams& params, double scale) {
+    std::vector<ColumnParams> result(columns_count, ColumnParams{ .max_distance = params.segment_len / scale });
+
+    for (const auto& region : regions) {
+        const ColumnParams local{ .max_distance = region.params.segment_len / scale,
+                                  .stretch = region.params.offset / params.offset };
+        std::fill(result.begin() + region.first_column, result.begin() + region.last_column + 1, local);
+    }
+    return result;
+}
+
+// Растягивает сжатую колонку по высоте относительно ее нижнего узла
+void StretchColumn(ls::LaminateData& layers, const ls::Column& column, double stretch) {
+    const double base = layers.getNode(column.front()).point.y;
+    for (const auto pos : column) {
+        double& y = layers.getNode(pos).point.y;
+        y = base + (y - base) * stretch;
+    }
+}
+
+// Вычисляет положение узлов колонки в оптимизированном эскизе по исходным координатам,
+// смещению колонки при сжатии, масштабу и растяжению колонки по высоте
+void PlaceColumn(const ls::LaminateData& original, ls::LaminateData& optimized, const ls::Column& column,
+                 const Point& shift, double scale, double stretch) {
+    const double base = original.getNode(column.front()).point.y - shift.y;
+    for (const auto pos : column) {
+        const Point& point = original.getNode(pos).point;
+        Point& result = optimized.getNode(pos).point;
+        result.x = (point.x - shift.x) * scale;
+        result.y = (base + (point.y - shift.y - base) * stretch) * scale;
+    }
+}
+
+std::pair<double, double> CalculateWidthAndHeight(const ls::LaminateData& layers) {
+    BoundingBox box;
+
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            for (const auto& node : ply) {
+                box.extend(node.point);
             }
-            else {
-                break;
+        }
+    }
+
+    return { box.width(), box.height() };
+}
+
+// Строит приближенную раскладку слоев для предварительного просмотра.
+// Ломаные растеризуются в сетку вертикальных полос, в каждой полосе упорядочиваются
+// по высоте, и порядковый номер ломаной в полосе становится высотой ее точек.
+// По горизонтали промежутки между соседними точками эскиза ограничиваются длиной сегмента,
+// что приближенно повторяет сжатие. Время работы O(n log n) по числу точек
+ls::LaminateData MakePreviewLayers(RawData raw_sketch, double offset, double segment_len) {
+    const StageTimer timer("preview");
+    MoveRawSketchToZero(raw_sketch);
+    // Заполнители в предварительном просмотре не отображаются
+    ExtractCores(raw_sketch);
+
+    BoundingBox box;
+    for (const auto& ply : raw_sketch) {
+        for (const auto& point : ply.polyline) {
+            box.extend(point);
+        }
+    }
+    if (box.isEmpty()) {
+        return {};
+    }
+
+    constexpr size_t bins_count = 512;
+    const double bin_width = std::max(box.width(), 1e-9) / bins_count;
+
+    auto bin_of = [&](double x) {
+        return std::min(static_cast<size_t>(std::max(x, 0.) / bin_width), bins_count - 1);
+    };
+
+    // Растеризация: для каждой полосы - высоты ломаных над центром полосы
+    std::vector<std::vector<std::pair<double, size_t>>> bins(bins_count);
+    std::vector<size_t> last_ply_in_bin(bins_count, std::numeric_limits<size_t>::max());
+
+    size_t ply_index = 0;
+    for (const auto& ply : raw_sketch) {
+        const auto& polyline = ply.polyline;
+        for (size_t i = 1; i < polyline.size(); ++i) {
+            const Point& p1 = polyline[i - 1];
+            const Point& p2 = polyline[i];
+            const double min_x = std::min(p1.x, p2.x);
+            const double max_x = std::max(p1.x, p2.x);
+
+            for (size_t bin = bin_of(min_x); bin <= bin_of(max_x); ++bin) {
+                const double center = (bin + 0.5) * bin_width;
+                if (center < min_x || center > max_x || last_ply_in_bin[bin] == ply_index) {
+                    continue;
+                }
+                const double t = IsZero(max_x - min_x) ? 0. : (center - p1.x) / (p2.x - p1.x);
+                bins[bin].emplace_back(p1.y + t * (p2.y - p1.y), ply_index);
+                last_ply_in_bin[bin] = ply_index;
             }
         }
-        auto next_pos = TryGetNextPos(pos, layers);
-        if (next_pos.has_value()) {
-            pos = layers.traceToBottom(next_pos.value());
+        ++ply_index;
+    }
+
+    // Порядковые номера ломаных в полосах и типичное расстояние между соседними ломаными
+    std::vector<std::vector<std::pair<size_t, size_t>>> ply_ranks(raw_sketch.size());  // (полоса, номер)
+    std::vector<double> gaps;
+
+    for (size_t bin = 0; bin < bins_count; ++bin) {
+        auto& stack = bins[bin];
+        std::sort(stack.begin(), stack.end());
+        for (size_t rank = 0; rank < stack.size(); ++rank) {
+            ply_ranks[stack[rank].second].emplace_back(bin, rank);
+            if (rank > 0 && !IsZero(stack[rank].first - stack[rank - 1].first, 1e-6)) {
+                gaps.push_back(stack[rank].first - stack[rank - 1].first);
+            }
         }
-        else {
-            break;
+    }
+
+    double gap = 1.;
+    if (!gaps.empty()) {
+        auto middle = gaps.begin() + gaps.size() / 2;
+        std::nth_element(gaps.begin(), middle, gaps.end());
+        gap = *middle;
+    }
+    const double scale = offset / gap;
+
+    // Приближенное сжатие по горизонтали
+    std::vector<double> xs;
+    for (const auto& ply : raw_sketch) {
+        for (const auto& point : ply.polyline) {
+            xs.push_back(point.x);
+        }
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end(),
+                         [](double lhs, double rhs) { return IsZero(rhs - lhs, 1e-6); }),
+             xs.end());
+
+    std::vector<double> compressed_xs(xs.size(), 0.);
+    for (size_t i = 1; i < xs.size(); ++i) {
+        compressed_xs[i] = compressed_xs[i - 1] + std::min((xs[i] - xs[i - 1]) * scale, segment_len);
+    }
+
+    auto compressed_x = [&](double x) {
+        auto it = std::lower_bound(xs.begin(), xs.end(), x - 1e-6);
+        if (it == xs.end()) {
+            --it;
+        }
+        return compressed_xs[std::distance(xs.begin(), it)];
+    };
+
+    // Высота точки - номер ломаной в ближайшей полосе, через которую она проходит
+    auto rank_at = [&](const std::vector<std::pair<size_t, size_t>>& ranks, double x) -> double {
+        if (ranks.empty()) {
+            return 0.;
+        }
+        const size_t bin = bin_of(x);
+        auto it = std::lower_bound(ranks.begin(), ranks.end(), std::make_pair(bin, size_t{ 0 }));
+        if (it == ranks.end()) {
+            --it;
+        }
+        else if (it != ranks.begin() && it->first != bin
+                 && bin - std::prev(it)->first < it->first - bin) {
+            --it;
+        }
+        return static_cast<double>(it->second);
+    };
+
+    // Сегменты упорядочиваются снизу вверх по среднему номеру
+    std::vector<std::pair<double, RawData::const_iterator>> order;
+    order.reserve(raw_sketch.size());
+    ply_index = 0;
+    for (auto it = raw_sketch.cbegin(); it != raw_sketch.cend(); ++it, ++ply_index) {
+        const auto& ranks = ply_ranks[ply_index];
+        double sum = 0.;
+        for (const auto& [bin, rank] : ranks) {
+            sum += rank;
+        }
+        order.emplace_back(ranks.empty() ? 0. : sum / ranks.size(), it);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+    ls::LaminateData result;
+    auto& layer = result.addLayer();
+    layer.reserve(order.size());
+
+    for (const auto& [mean_rank, it] : order) {
+        const auto& ranks = ply_ranks[std::distance(raw_sketch.cbegin(), it)];
+        const unsigned short ply_pos = layer.pliesCount();
+        auto& ply = layer.addPly();
+        ply.orientation = it->orientation;
+        ply.meta = it->meta;
+        ply.reserve(it->pointsCount());
+
+        for (unsigned short i = 0; i < it->pointsCount(); ++i) {
+            const Point& point = it->pointAt(i);
+            ply.addNode(ls::Node{
+                .point = { compressed_x(point.x), rank_at(ranks, point.x) * offset },
+                .position = {.layerPos = 0, .plyPos = ply_pos, .nodePos = i }
+            });
         }
     }
+    return result;
 }
 
-void CompressSketch(ls::LaminateData& layers, double max_distance) {
-    auto first = layers.findRootNode();
-    auto second = TryGetNextPos(first, layers).value();
+// Преобразует данные эскиза в "сырой" эскиз
+RawData ConvertLaminateToRawSketch(const ls::LaminateData& layers) {
+    RawData result;
 
-    while (true) {
-        double distance = GetMinDistanceBetweenGroupNodes(first, second, layers);
-        if (max_distance < distance) {
-            CompressPairGroupNodes(first, second, layers, max_distance);
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            auto& new_layer = result.emplace_back(RawPolyline{});
+
+            new_layer.orientation = ply.orientation;
+            new_layer.meta = ply.meta;
+            new_layer.reserve(ply.pointsCount());
+
+            for (const auto& node : ply) {
+                new_layer.polyline.emplace_back(node.point);
+            }
         }
-        auto next_pos = TryGetNextPos(second, layers);
-        if (next_pos.has_value()) {
-            first = second;
-            second = layers.traceToBottom(next_pos.value());
+    }
+
+    return result;
+}
+
+// Распределяет заполнители по сечениям: заполнитель относится к сечению, габарит которого
+// содержит центр его габарита, иначе к первому пересекающемуся. Заполнители вне сечений отбрасываются
+std::vector<std::vector<Polygon>> AssignCoresToSections(const std::vector<RawData>& sections,
+                                                        std::vector<Polygon>&& cores) {
+    std::vector<std::vector<Polygon>> result(sections.size());
+    if (cores.empty()) {
+        return result;
+    }
+
+    std::vector<BoundingBox> boxes(sections.size());
+    for (size_t i = 0; i < sections.size(); ++i) {
+        for (const auto& ply : sections[i]) {
+            for (const auto& point : ply.polyline) {
+                boxes[i].extend(point);
+            }
         }
-        else {
-            break;
+    }
+
+    for (auto& core : cores) {
+        BoundingBox core_box;
+        for (const auto& point : core.points()) {
+            core_box.extend(point);
+        }
+        const Point center{ (core_box.left + core_box.right) / 2., (core_box.bottom + core_box.top) / 2. };
+
+        auto it = std::find_if(boxes.begin(), boxes.end(),
+                               [&center](const BoundingBox& box) { return box.contains(center); });
+        if (it == boxes.end()) {
+            it = std::find_if(boxes.begin(), boxes.end(),
+                              [&core_box](const BoundingBox& box) { return box.intersects(core_box); });
+        }
+        if (it != boxes.end()) {
+            result[it - boxes.begin()].push_back(std::move(core));
         }
     }
+    return result;
 }
 
-std::pair<double, double> CalculateWidthAndHeight(ls::LaminateData& layers) {
-    double left = std::numeric_limits<double>::max();
-    double bottom = std::numeric_limits<double>::max();
-    double right = std::numeric_limits<double>::min();
-    double top = std::numeric_limits<double>::min();
+// Преобразует одно независимое сечение эскиза
+ls::ConvertedSketch ConvertSection(RawData&& raw_sketch, size_t threads_count, const Progress& progress) {
+    ls::ConvertedSketch result;
+    result.data = ConvertRawSketch(std::move(raw_sketch), progress, result.report, threads_count);
 
-    for (auto& layer : layers) {
+    if (result.data.isEmpty()) {
+        return result;
+    }
+
+    result.minDistanceBetweenPlies = GetMinDistanceBetweenPlies(result.data);
+
+    // Колонки не зависят от параметров и строятся один раз на все оптимизации
+    result.columns = BuildColumns(result.data);
+    result.sections.push_back(ls::Section{ .fixedNodes = GetFixedNodes(result.data, result.columns) });
+
+    return result;
+}
+
+// Ключ сечения в кэше преобразованных сечений
+struct SectionKey {
+    size_t hash = 0;
+    size_t points_count = 0;
+    Point corner;
+};
+
+// Хеш сечения по хешам его ломаных относительно левого нижнего угла сечения и данным
+// их исходных слоев. Хеши ломаных сортируются, поэтому порядок ломаных в файле не учитывается
+SectionKey GetSectionKey(const RawData& raw_section) {
+    SectionKey key;
+    key.corner = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    for (const auto& raw : raw_section) {
+        for (const auto& point : raw.polyline) {
+            key.corner = { std::min(key.corner.x, point.x), std::min(key.corner.y, point.y) };
+        }
+        key.points_count += raw.pointsCount();
+    }
+
+    std::vector<size_t> hashes;
+    hashes.reserve(raw_section.size());
+    for (const auto& raw : raw_section) {
+        hashes.push_back(HashPolyline(raw, key.corner) ^ (std::hash<PlyMetaId>{}(raw.meta) << 1));
+    }
+    std::sort(hashes.begin(), hashes.end());
+
+    for (const size_t hash : hashes) {
+        key.hash ^= hash + 0x9e3779b97f4a7c15 + (key.hash << 6) + (key.hash >> 2);
+    }
+    return key;
+}
+
+// Смещает преобразованное сечение на 'shift'
+void TranslateSection(ls::ConvertedSketch& section, Point shift) {
+    for (auto& layer : section.data) {
         for (auto& ply : layer) {
             for (auto& node : ply) {
-                left = std::min(left, node.point.x);
-                right = std::max(right, node.point.x);
-                bottom = std::min(bottom, node.point.y);
-                top = std::max(top, node.point.y);
+                node.point = { node.point.x + shift.x, node.point.y + shift.y };
+            }
+        }
+    }
+    for (auto& cost : section.report.expensive) {
+        cost.first = { cost.first.x + shift.x, cost.first.y + shift.y };
+        cost.last = { cost.last.x + shift.x, cost.last.y + shift.y };
+    }
+}
+
+// Объединяет преобразованные сечения в один эскиз. Слои сечений объединяются по номеру
+// снизу вверх, сегменты и колонки каждого следующего сечения добавляются после предыдущих.
+// Сечения выравниваются по нижней границе и размещаются слева направо
+// с промежутком в 'sections_gap' расстояний между слоями
+ls::ConvertedSketch MergeSections(std::vector<ls::ConvertedSketch>&& sections) {
+    const StageTimer timer("merge");
+    if (sections.size() == 1) {
+        return std::move(sections.front());
+    }
+
+    constexpr double sections_gap = 10.;
+
+    ls::ConvertedSketch result;
+    result.minDistanceBetweenPlies = std::numeric_limits<double>::max();
+
+    size_t layers_count = 0;
+    for (const auto& section : sections) {
+        result.minDistanceBetweenPlies = std::min(result.minDistanceBetweenPlies, section.minDistanceBetweenPlies);
+        layers_count = std::max(layers_count, section.data.layersCount());
+    }
+
+    // Эскиз без связанных слоев не имеет масштаба, промежуток между сечениями не добавляется
+    const double gap = (result.minDistanceBetweenPlies < std::numeric_limits<double>::max())
+                           ? sections_gap * result.minDistanceBetweenPlies : 0.;
+
+    result.data.reserveLayers(layers_count);
+    for (size_t i = 0; i < layers_count; ++i) {
+        result.data.addLayer();
+    }
+
+    double right = 0.;
+    for (size_t index = 0; index < sections.size(); ++index) {
+        auto& section = sections[index];
+
+        BoundingBox box;
+        for (const auto& layer : section.data) {
+            for (const auto& ply : layer) {
+                for (const auto& node : ply) {
+                    box.extend(node.point);
+                }
+            }
+        }
+        const Point shift{ (index == 0) ? 0. : right + gap - box.left, -box.bottom };
+        right = box.right + shift.x;
+
+        // Смещения номеров сегментов сечения в каждом слое объединенного эскиза
+        std::vector<unsigned short> ply_shifts;
+        ply_shifts.reserve(section.data.layersCount());
+        for (size_t layer_pos = 0; layer_pos < section.data.layersCount(); ++layer_pos) {
+            ply_shifts.push_back(static_cast<unsigned short>(result.data.getLayer(layer_pos).pliesCount()));
+        }
+
+        auto remap = [&ply_shifts](ls::NodePosition pos) {
+            pos.plyPos += ply_shifts[pos.layerPos];
+            return pos;
+        };
+
+        for (size_t layer_pos = 0; layer_pos < section.data.layersCount(); ++layer_pos) {
+            auto& new_layer = result.data.getLayer(layer_pos);
+            for (auto& ply : section.data.getLayer(layer_pos)) {
+                auto& new_ply = new_layer.addPly();
+                new_ply = std::move(ply);
+                for (auto& node : new_ply) {
+                    node.point.x += shift.x;
+                    node.point.y += shift.y;
+                    node.position = remap(node.position);
+                    if (node.upperLink.has_value()) {
+                        node.upperLink = remap(*node.upperLink);
+                    }
+                    if (node.lowerLink.has_value()) {
+                        node.lowerLink = remap(*node.lowerLink);
+                    }
+                }
+            }
+        }
+
+        ls::Section& new_section = result.sections.emplace_back(ls::Section{ .firstColumn = result.columns.size(),
+                                                                             .origin = { -shift.x, -shift.y } });
+        for (auto& column : section.columns) {
+            std::transform(column.begin(), column.end(), column.begin(), remap);
+            result.columns.push_back(std::move(column));
+        }
+        new_section.fixedNodes = std::move(section.sections.front().fixedNodes);
+        std::transform(new_section.fixedNodes.begin(), new_section.fixedNodes.end(),
+                       new_section.fixedNodes.begin(), remap);
+
+        for (const auto& core : section.cores) {
+            auto& new_core = result.cores.emplace_back();
+            for (const auto& point : core.points()) {
+                new_core.addPoint({ point.x + shift.x, point.y + shift.y });
             }
         }
     }
+    return result;
+}
+
+// Переводит эскиз в координаты исходного файла. Сечения размещаются в эскизе иначе,
+// чем в файле, поэтому каждый сегмент смещается на положение своего сечения
+ls::LaminateData ToSourceCoordinates(ls::LaminateData layers, const std::vector<ls::Column>& columns,
+                                     const std::vector<ls::Section>& sections) {
+    std::vector<std::vector<size_t>> section_of;
+    section_of.reserve(layers.layersCount());
+    for (const auto& layer : layers) {
+        section_of.emplace_back(layer.pliesCount(), 0);
+    }
+
+    for (size_t index = 0; index < sections.size(); ++index) {
+        auto mark = [&](ls::NodePosition pos) { section_of[pos.layerPos][pos.plyPos] = index; };
 
-    return { right - left, top - bottom };
+        const size_t end = (index + 1 < sections.size()) ? sections[index + 1].firstColumn : columns.size();
+        for (size_t column = sections[index].firstColumn; column < end; ++column) {
+            std::for_each(columns[column].begin(), columns[column].end(), mark);
+        }
+        std::for_each(sections[index].fixedNodes.begin(), sections[index].fixedNodes.end(), mark);
+    }
+
+    for (auto& layer : layers) {
+        for (auto& ply : layer) {
+            if (ply.pointsCount() == 0 || sections.empty()) {
+                continue;
+            }
+            const Point& origin = sections[section_of[ply[0].position.layerPos][ply[0].position.plyPos]].origin;
+            for (auto& node : ply) {
+                node.point = { node.point.x + origin.x, node.point.y + origin.y };
+            }
+        }
+    }
+    return layers;
 }
 
 } // namespace domain
@@ -498,68 +1358,684 @@ namespace ls {
 
 using namespace domain;
 
+namespace {
+
+std::uint64_t PackNodePosition(NodePosition pos) {
+    return (static_cast<std::uint64_t>(pos.layerPos) << 32) | (static_cast<std::uint64_t>(pos.plyPos) << 16) | pos.nodePos;
+}
+
+
+// Оптимизирует исходный эскиз 'original': сжатие колонок, растяжение участков с локальными
+// параметрами и масштабирование. При запросе остановки или по истечении времени возвращает std::nullopt
+std::optional<OptimizedSketch> OptimizeLayers(const LaminateData& original, const std::vector<Column>& columns,
+                                              const std::vector<Section>& sections,
+                                              const std::vector<RegionParams>& regions,
+                                              const std::vector<double>& core_steps,
+                                              double min_distance, const OptimizationParams& params,
+                                              const Progress& progress) {
+    const StageTimer timer("optimize");
+    OptimizedSketch result{ .data = original, .params = params };
+
+    double scale = params.offset / min_distance;
+
+    const auto column_params = GetColumnParams(columns.size(), regions, result.params, scale);
+
+    progress.addWork(columns.size());
+    auto shifts = CompressSketch(result.data, columns, sections,
+                                 [&column_params, &core_steps](size_t index) {
+                                     return LimitByCores(core_steps, index, column_params[index].max_distance);
+                                 }, progress);
+    if (!shifts.has_value()) {
+        return std::nullopt;
+    }
+    result.shifts = std::move(*shifts);
+
+    {
+        const StageTimer stretch_timer("stretch");
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (column_params[i].stretch != 1.) {
+                StretchColumn(result.data, columns[i], column_params[i].stretch);
+            }
+        }
+    }
+    {
+        const StageTimer scale_timer("scale");
+        ScaleLayers(result.data, scale);
+        std::tie(result.width, result.height) = CalculateWidthAndHeight(result.data);
+    }
+
+    return result;
+}
+
+} // namespace
+
 domain::RawData Interface::rawSketch() const {
-    RawData result;
+    return ConvertLaminateToRawSketch(optimized_data_);
+}
 
-    for (const auto& layer : optimized_data_) {
-        for (const auto& ply : layer) {
-            auto& new_layer = result.emplace_back(RawPolyline{});
+std::vector<domain::PlyLabel> Interface::plyLabels(double text_height) const {
+    return domain::PlacePlyLabels(optimized_data_, text_height);
+}
 
-            new_layer.orientation = ply.orientation;
+std::optional<domain::ProfileStation> Interface::profileStationAt(NodePosition node) const {
+    if (node.layerPos >= original_data_.layersCount()
+        || node.plyPos >= original_data_.getLayer(node.layerPos).pliesCount()) {
+        return std::nullopt;
+    }
+    const size_t points_count = original_data_.getLayer(node.layerPos).getPly(node.plyPos).pointsCount();
 
-            for (const auto& node : ply) {
-                new_layer.polyline.emplace_back(node.point);
+    // Узлы вне колонок берут станцию ближайшего по сегменту узла колонки
+    for (size_t step = 0; step < points_count; ++step) {
+        for (const int direction : { -1, 1 }) {
+            const long long pos = static_cast<long long>(node.nodePos) + direction * static_cast<long long>(step);
+            if (pos < 0 || pos >= static_cast<long long>(points_count)) {
+                continue;
+            }
+            NodePosition candidate = node;
+            candidate.nodePos = static_cast<unsigned short>(pos);
+            if (const auto it = node_stations_.find(PackNodePosition(candidate)); it != node_stations_.end()) {
+                return profile_[it->second];
             }
         }
     }
+    return std::nullopt;
+}
 
+std::vector<domain::Polygon> Interface::cores() const {
+    if (optimized_data_.isEmpty()) {
+        return {};
+    }
+    // Отступ оставляет между штриховкой и линиями слоев зазор в долю расстояния между слоями
+    return domain::PlaceCores(optimized_data_, core_anchors_, params_.offset * 0.2);
+}
+
+domain::SketchDiff Interface::diffWith(const ConvertedSketch& before) const {
+    // Допуск - как при удалении лишних точек при импорте. Слой, сместившийся больше чем
+    // на несколько толщин пакета, считается удаленным и добавленным заново
+    constexpr double tolerance = 1e-3;
+    constexpr double plies_in_radius = 10.;
+    // Каждая редакция перенесена в начало координат и разложена по сечениям по-своему:
+    // слой, добавленный ниже или левее прежнего габарита, сместил бы все остальные слои.
+    // Поэтому редакции сравниваются в координатах исходного файла
+    double match_radius = plies_in_radius * minDistanceBetweenPlies_;
+    if (!std::isfinite(match_radius) || !(match_radius > tolerance)) {
+        // В эскизе без соседних слоев расстояние между слоями не определено
+        // (наибольшее число double), а совпадающие слои дают нулевое расстояние.
+        // Тогда радиус поиска - габарит эскиза, но не меньше допуска
+        const auto [width, height] = CalculateWidthAndHeight(original_data_);
+        match_radius = std::max(tolerance, std::max(width, height));
+    }
+    return domain::DiffSketches(ToSourceCoordinates(before.data, before.columns, before.sections),
+                                ToSourceCoordinates(original_data_, columns_, sections_),
+                                tolerance, match_radius);
+}
+
+std::vector<domain::DiffHighlight> Interface::diffHighlights(const domain::SketchDiff& diff) const {
+    std::vector<domain::DiffHighlight> result;
+    if (optimized_data_.isEmpty()) {
+        return result;
+    }
+    result.reserve(diff.size());
+
+    for (const auto& change : diff) {
+        auto& highlight = result.emplace_back(domain::DiffHighlight{ .kind = change.kind });
+        if (change.after.has_value()) {
+            const auto& ply = optimized_data_.getLayer(change.after->layerPos).getPly(change.after->plyPos);
+            highlight.polyline.reserve(ply.pointsCount());
+            for (const auto& node : ply) {
+                highlight.polyline.push_back(node.point);
+            }
+        }
+        else if (change.anchor.has_value()) {
+            highlight.polyline.push_back(optimized_data_.getNode(*change.anchor).point);
+        }
+        else {
+            result.pop_back();
+        }
+    }
     return result;
 }
 
 bool Interface::fillSketch(domain::RawData&& raw_sketch) {
 
-    MoveRawSketchToZero(raw_sketch);
+    if (!setConverted(convertSketch(std::move(raw_sketch)).value())) {
+        return false;
+    }
+
+    optimizeSketch(Interface::DefaultOffset, Interface::DefaultSegLen);
+
+    return true;
+}
+
+std::optional<ConvertedSketch> Interface::convertSketch(domain::RawData&& raw_sketch, const Progress& progress,
+                                                       SectionCache* cache) {
+    const StageTimer timer("convert");
+
+    const Point origin = MoveRawSketchToZero(raw_sketch);
+
+    // Разрывы и дубликаты ломаных создают лишние сегменты, увеличивающие время всех этапов
+    const CleanupReport cleanup = CleanupRawSketch(raw_sketch);
+
+    // Замкнутые контуры - заполнители, они не участвуют в построении слоев
+    auto cores = ExtractCores(raw_sketch);
+
+    // Работа - построение пробной геометрии и выделение в слой для каждой ломаной
+    progress.addWork(2 * raw_sketch.size());
+
+    auto raw_sections = SplitIntoSections(std::move(raw_sketch));
+    if (raw_sections.empty()) {
+        return ConvertedSketch{ .cleanup = cleanup };
+    }
+    auto sections_cores = AssignCoresToSections(raw_sections, std::move(cores));
+
+    std::vector<ConvertedSketch> sections(raw_sections.size());
+    std::vector<SectionKey> keys;
+    std::vector<size_t> to_convert;
+    size_t reused_count = 0;
+
+    for (size_t index = 0; index < raw_sections.size(); ++index) {
+        if (cache == nullptr) {
+            to_convert.push_back(index);
+            continue;
+        }
+        const SectionKey& key = keys.emplace_back(GetSectionKey(raw_sections[index]));
+        const auto it = cache->find(key.hash);
+        if (it == cache->end() || it->second.points_count != key.points_count) {
+            to_convert.push_back(index);
+            continue;
+        }
+        // Сечение не изменилось относительно своего угла, но могло сместиться вместе с ним
+        sections[index] = it->second.sketch;
+        TranslateSection(sections[index], { key.corner.x - it->second.corner.x,
+                                            key.corner.y - it->second.corner.y });
+        progress.advance(2 * raw_sections[index].size());
+        ++reused_count;
+    }
+
+    // Сечения преобразуются параллельно, оставшиеся потоки делятся между ними
+    // для соединения узлов внутри слоя
+    const size_t threads_count = std::max<size_t>(1, DefaultThreadsCount() / std::max<size_t>(1, to_convert.size()));
 
-    auto data = ls::ConvertRawSketch(std::move(raw_sketch));
+    {
+        const StageTimer sections_timer("sections");
+        ParallelFor(to_convert.size(), [&](size_t i) {
+            const size_t index = to_convert[i];
+            sections[index] = ConvertSection(std::move(raw_sections[index]), threads_count, progress);
+        });
+    }
+
+    if (progress.isCancelled()) {
+        return std::nullopt;
+    }
+
+    // В кэше остаются только полностью преобразованные сечения текущего эскиза
+    if (cache != nullptr) {
+        SectionCache updated;
+        for (size_t index = 0; index < sections.size(); ++index) {
+            if (sections[index].report.status == ConversionStatus::Completed && !sections[index].data.isEmpty()) {
+                updated.emplace(keys[index].hash, CachedSection{ .points_count = keys[index].points_count,
+                                                                 .corner = keys[index].corner,
+                                                                 .sketch = sections[index] });
+            }
+        }
+        *cache = std::move(updated);
+    }
+
+    for (size_t index = 0; index < sections.size(); ++index) {
+        sections[index].cores = std::move(sections_cores[index]);
+    }
+
+    // Итог по сечениям: истечение времени важнее ошибки выделения слоя,
+    // так как при большем ограничении времени эскиз может быть преобразован полностью
+    ConversionReport report;
+    report.sections_count = sections.size();
+    report.reused_sections = reused_count;
+    std::vector<PolylineCost> costs;
+    for (auto& section : sections) {
+        report.total_polylines += section.report.total_polylines;
+        report.remaining_polylines += section.report.remaining_polylines;
+        if (section.report.status == ConversionStatus::TimedOut
+            || (section.report.status == ConversionStatus::Failed && !report.isPartial())) {
+            report.status = section.report.status;
+        }
+        costs.insert(costs.end(), section.report.expensive.begin(), section.report.expensive.end());
+    }
+    for (auto& cost : costs) {
+        cost.first = { cost.first.x + origin.x, cost.first.y + origin.y };
+        cost.last = { cost.last.x + origin.x, cost.last.y + origin.y };
+    }
+    CollectExpensive(std::move(costs), report);
+
+    // Сечения, в которых не выделено ни одного слоя, не входят в частичный результат
+    sections.erase(std::remove_if(sections.begin(), sections.end(),
+                                  [](const auto& section) { return section.data.isEmpty(); }),
+                   sections.end());
+    if (sections.empty()) {
+        return ConvertedSketch{ .cleanup = cleanup, .report = std::move(report) };
+    }
 
-    if (data.isEmpty()) {
+    auto result = MergeSections(std::move(sections));
+    for (auto& section : result.sections) {
+        section.origin = { section.origin.x + origin.x, section.origin.y + origin.y };
+    }
+    result.cleanup = cleanup;
+    result.report = std::move(report);
+    return result;
+}
+
+bool Interface::setConverted(ConvertedSketch&& sketch) {
+    const StageTimer timer("publish");
+    if (sketch.data.isEmpty()) {
         return false;
     }
-    else {
 
-        original_data_ = (std::move(data));
+    original_data_ = std::move(sketch.data);
+    minDistanceBetweenPlies_ = sketch.minDistanceBetweenPlies;
+    columns_ = std::move(sketch.columns);
+    sections_ = std::move(sketch.sections);
+    core_anchors_ = AnchorCores(original_data_, sketch.cores);
+    core_steps_ = GetCoreSteps(original_data_, columns_, core_anchors_);
+    cleanup_report_ = sketch.cleanup;
+    conversion_report_ = std::move(sketch.report);
+    profile_ = domain::BuildThicknessProfile(original_data_, columns_, sections_, minDistanceBetweenPlies_);
+
+    // Станции профиля упорядочены по x, колонка станции хранится в ней
+    node_stations_.clear();
+    for (size_t station = 0; station < profile_.size(); ++station) {
+        for (const auto pos : columns_[profile_[station].column]) {
+            node_stations_.emplace(PackNodePosition(pos), station);
+        }
+    }
+    regions_.clear();
 
-        minDistanceBetweenPlies_ = GetMinDistanceBetweenPlies(original_data_);
+    // Прежний оптимизированный эскиз имеет другую структуру узлов и не должен использоваться
+    optimized_data_.clear();
+    shifts_.clear();
+    params_ = {};
+    width_ = height_ = 0.;
+
+    // Структура оптимизированного эскиза совпадает с исходной, поэтому порядок узлов
+    // для истории изменений строится один раз
+    nodes_order_.clear();
+    for (const auto& layer : original_data_) {
+        for (const auto& ply : layer) {
+            for (const auto& node : ply) {
+                nodes_order_.push_back(node.position);
+            }
+        }
+    }
+    history_.clear();
+    history_pos_ = 0;
+    is_modified_ = false;
 
-        optimizeSketch(Interface::DefaultOffset, Interface::DefaultSegLen);
+    return true;
+}
 
-        return true;
+bool Interface::setConverted(ConvertedSketch&& sketch, OptimizedSketch&& optimized) {
+    if (!setConverted(std::move(sketch))) {
+        return false;
     }
+    setOptimized(std::move(optimized));
+    return true;
+}
+
+PreviewSketch Interface::makePreview(const domain::RawData& raw_sketch, double offset, double segment_len) {
+    PreviewSketch result{ .data = MakePreviewLayers(raw_sketch, offset, segment_len) };
+    std::tie(result.width, result.height) = CalculateWidthAndHeight(result.data);
+    return result;
 }
 
 void Interface::scaleSketch(double scale) {
     ScaleLayers(optimized_data_, scale);
+    shifts_.clear();    // Масштабированный эскиз не подлежит инкрементальному пересчету
+    is_modified_ = true;
 }
 
 void Interface::optimizeSketch(double offset, double segment_len) {
-    auto temp_layers_ = original_data_;
+    setOptimized(makeOptimized(offset, segment_len).value());
+}
+
+std::optional<OptimizedSketch> Interface::makeOptimized(double offset, double segment_len,
+                                                        const Progress& progress) const {
+    return OptimizeLayers(original_data_, columns_, sections_, regions_, core_steps_, minDistanceBetweenPlies_,
+                          { .offset = offset, .segment_len = segment_len }, progress);
+}
+
+std::optional<OptimizedSketch> Interface::optimizeConverted(const ConvertedSketch& sketch, double offset,
+                                                            double segment_len, const Progress& progress) {
+    if (sketch.data.isEmpty()) {
+        return std::nullopt;
+    }
+    // Локальные параметры участков сбрасываются при публикации преобразованного эскиза
+    const auto core_steps = GetCoreSteps(sketch.data, sketch.columns, AnchorCores(sketch.data, sketch.cores));
+    return OptimizeLayers(sketch.data, sketch.columns, sketch.sections, {}, core_steps, sketch.minDistanceBetweenPlies,
+                          { .offset = offset, .segment_len = segment_len }, progress);
+}
 
-    double scale = offset / minDistanceBetweenPlies_;
+void Interface::setOptimized(OptimizedSketch&& sketch) {
+    width_ = sketch.width, height_ = sketch.height;
+    params_ = sketch.params;
 
-    CompressSketch(temp_layers_, segment_len / scale);
+    std::swap(optimized_data_, sketch.data);
+    std::swap(shifts_, sketch.shifts);
 
-    ScaleLayers(temp_layers_, scale);
+    is_modified_ = true;
+}
 
-    auto [width, height] = CalculateWidthAndHeight(temp_layers_);
+std::optional<std::pair<size_t, size_t>> Interface::columnsInRange(double left, double right) const {
+    if (shifts_.size() != columns_.size()) {
+        return std::nullopt;
+    }
 
-    width_ = width, height_ = height;
+    std::optional<std::pair<size_t, size_t>> result;
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        const double x = optimized_data_.getNode(columns_[i].front()).point.x;
+        if (x < left || x > right) {
+            continue;
+        }
+        if (result.has_value()) {
+            result->second = i;
+        }
+        else {
+            result.emplace(i, i);
+        }
+    }
+    return result;
+}
+
+bool Interface::setRegionParams(const RegionParams& region) {
+    // Инкрементальный пересчет возможен только для эскиза, оптимизированного из текущих исходных данных
+    if (isEmpty() || shifts_.size() != columns_.size()
+        || region.first_column > region.last_column || region.last_column >= columns_.size()
+        || region.params.offset <= 0. || region.params.segment_len <= 0.) {
+        return false;
+    }
+
+    regions_.push_back(region);
+
+    const double scale = params_.offset / minDistanceBetweenPlies_;
+    const double max_distance = region.params.segment_len / scale;
+    const double stretch = region.params.offset / params_.offset;
+
+    // Колонки участка пересчитываются по исходным координатам
+    const Point old_last_shift = shifts_[region.last_column];
+    Point shift = (region.first_column == 0) ? Point{} : shifts_[region.first_column - 1];
+
+    for (size_t i = region.first_column; i <= region.last_column; ++i) {
+        if (i != 0) {
+            const Point step = GetColumnStep(original_data_, columns_, sections_, i,
+                                             LimitByCores(core_steps_, i, max_distance));
+            shift.x += step.x;
+            shift.y += step.y;
+        }
+        shifts_[i] = shift;
+        PlaceColumn(original_data_, optimized_data_, columns_[i], shift, scale, stretch);
+    }
+
+    // Колонки правее участка смещаются на изменение накопленного смещения
+    const Point delta{ shift.x - old_last_shift.x, shift.y - old_last_shift.y };
+    if (delta.x != 0. || delta.y != 0.) {
+        for (size_t i = region.last_column + 1; i < columns_.size(); ++i) {
+            shifts_[i].x += delta.x;
+            shifts_[i].y += delta.y;
+            for (const auto pos : columns_[i]) {
+                Point& point = optimized_data_.getNode(pos).point;
+                point.x -= delta.x * scale;
+                point.y -= delta.y * scale;
+            }
+        }
+    }
+
+    // Узлы вне колонок смещаются вместе с первой колонкой своего сечения
+    for (const auto& section : sections_) {
+        if (section.firstColumn <= region.first_column) {
+            continue;
+        }
+        const Point& section_shift = shifts_[section.firstColumn];
+        for (const auto pos : section.fixedNodes) {
+            const Point& point = original_data_.getNode(pos).point;
+            optimized_data_.getNode(pos).point = { (point.x - section_shift.x) * scale,
+                                                   (point.y - section_shift.y) * scale };
+        }
+    }
+
+    std::tie(width_, height_) = CalculateWidthAndHeight(optimized_data_);
+    is_modified_ = true;
+
+    return true;
+}
+
+void Interface::commit(bool replace_last) {
+    if (isEmpty() || !is_modified_ || optimized_data_.isEmpty()) {
+        return;
+    }
+    is_modified_ = false;
+
+    // Точное сравнение: блоки разделяются только при совпадении всех координат
+    auto is_same = [](const Point& lhs, const Point& rhs) { return lhs.x == rhs.x && lhs.y == rhs.y; };
+
+    const SketchSnapshot* base = history_.empty() ? nullptr : &history_[history_pos_];
+    const SketchSnapshot empty;
+
+    auto node = nodes_order_.begin();
+    auto shift = shifts_.begin();
+
+    SketchSnapshot snapshot{
+        .params = params_,
+        .regions = regions_,
+        .width = width_,
+        .height = height_,
+        .points = PersistentArray<Point>::build(nodes_order_.size(),
+                                                [&] { return optimized_data_.getNode(*node++).point; },
+                                                base ? base->points : empty.points, is_same),
+        .shifts = PersistentArray<Point>::build(shifts_.size(), [&] { return *shift++; },
+                                                base ? base->shifts : empty.shifts, is_same)
+    };
+
+    if (base != nullptr && base->params == snapshot.params && base->regions == snapshot.regions
+        && base->points.isSharedWith(snapshot.points) && base->shifts.isSharedWith(snapshot.shifts)) {
+        return;     // Состояние не изменилось
+    }
+
+    history_.erase(history_.begin() + (history_.empty() ? 0 : history_pos_ + 1), history_.end());
+    if (replace_last && history_.size() > 1) {
+        history_.pop_back();
+    }
+    history_.push_back(std::move(snapshot));
+    if (history_.size() > MaxHistorySize) {
+        history_.pop_front();
+    }
+    history_pos_ = history_.size() - 1;
+}
+
+bool Interface::undo() {
+    commit();   // Несохраненные изменения становятся последним состоянием истории
+    if (!canUndo()) {
+        return false;
+    }
+    restore(history_pos_ - 1);
+    return true;
+}
+
+bool Interface::redo() {
+    if (is_modified_ || !canRedo()) {
+        return false;
+    }
+    restore(history_pos_ + 1);
+    return true;
+}
+
+void Interface::restore(size_t history_pos) {
+    const SketchSnapshot& current = history_[history_pos_];
+    const SketchSnapshot& target = history_[history_pos];
+
+    target.points.forEachChanged(current.points, [this](size_t index, const Point& point) {
+        optimized_data_.getNode(nodes_order_[index]).point = point;
+    });
+
+    // Текущее состояние сохранено в истории, поэтому размер смещений совпадает с ним
+    shifts_.resize(target.shifts.size());
+    target.shifts.forEachChanged(current.shifts, [this](size_t index, const Point& shift) {
+        shifts_[index] = shift;
+    });
+
+    params_ = target.params;
+    regions_ = target.regions;
+    width_ = target.width;
+    height_ = target.height;
+
+    history_pos_ = history_pos;
+}
+
+std::vector<SweepResult> Interface::sweepParameters(const std::vector<OptimizationParams>& grid,
+                                                   bool with_sketches) const {
+    std::vector<SweepResult> result(grid.size());
+
+    if (isEmpty()) {
+        return result;
+    }
+
+    // Каждая задача читает общие исходные данные и пишет только в свой элемент результата
+    ParallelFor(grid.size(), [&](size_t index) {
+        auto& item = result[index];
+        item.params = grid[index];
+
+        auto sketch = makeOptimized(item.params.offset, item.params.segment_len).value();
+        item.width = sketch.width;
+        item.height = sketch.height;
+
+        if (with_sketches) {
+            item.sketch = ConvertLaminateToRawSketch(sketch.data);
+        }
+    });
+
+    return result;
+}
+
+std::optional<SweepResult> Interface::autoFit(double sheet_width, double sheet_height,
+                                              const ParamsLimits& limits) const {
+    // Неположительные пределы дают логарифм от нуля, перевернутые - вырожденную сетку поиска
+    if (isEmpty() || !(sheet_width > 0.) || !(sheet_height > 0.)
+        || !(limits.min_offset > 0.) || !(limits.min_segment_len > 0.)
+        || !(limits.max_offset >= limits.min_offset) || !(limits.max_segment_len >= limits.min_segment_len)) {
+        return std::nullopt;
+    }
+
+    // Эскиз с параметрами (offset, segment_len) - это исходный эскиз, сжатый с
+    // max_distance = segment_len / scale и увеличенный в scale = offset / minDistanceBetweenPlies_ раз.
+    // Поэтому поиск ведется по одной переменной max_distance: для каждого ее значения
+    // наибольший масштаб, при котором эскиз помещается на лист, вычисляется напрямую
+    const double min_scale = limits.min_offset / minDistanceBetweenPlies_;
+    const double max_scale = limits.max_offset / minDistanceBetweenPlies_;
+
+    struct Candidate {
+        double max_distance = 0.;
+        double scale = 0.;          // 0 - параметры недопустимы
+        BoundingBox box;
+    };
+
+    auto evaluate = [&](double max_distance) {
+        Candidate result{ .max_distance = max_distance,
+                          .box = GetCompressedBox(original_data_, columns_, sections_, core_steps_, max_distance) };
+
+        double scale = std::min(max_scale, limits.max_segment_len / max_distance);
+        if (result.box.width() > 0.) {
+            scale = std::min(scale, sheet_width / result.box.width());
+        }
+        if (result.box.height() > 0.) {
+            scale = std::min(scale, sheet_height / result.box.height());
+        }
+        if (scale >= min_scale && scale * max_distance >= limits.min_segment_len) {
+            result.scale = scale;
+        }
+        return result;
+    };
+
+    // Больший масштаб лучше, при равном масштабе предпочтительнее более длинные сегменты
+    auto is_better = [](const Candidate& lhs, const Candidate& rhs) {
+        if (!ApproximatelyEqual(lhs.scale, rhs.scale)) {
+            return lhs.scale > rhs.scale;
+        }
+        return lhs.max_distance > rhs.max_distance;
+    };
+
+    // Поиск в логарифмическом масштабе: грубая сетка, затем золотое сечение вокруг лучшего узла
+    const double log_min = std::log(limits.min_segment_len / max_scale);
+    const double log_max = std::log(limits.max_segment_len / min_scale);
+
+    constexpr int grid_size = 16;
+    const double step = (log_max - log_min) / (grid_size - 1);
+
+    Candidate best;
+    int best_index = 0;
+    for (int i = 0; i < grid_size; ++i) {
+        auto candidate = evaluate(std::exp(log_min + step * i));
+        if (i == 0 || is_better(candidate, best)) {
+            best = candidate;
+            best_index = i;
+        }
+    }
+
+    if (best.scale == 0.) {
+        return std::nullopt;
+    }
+
+    constexpr double inv_phi = 0.6180339887498949;
+    constexpr int refine_iterations = 20;
+
+    double lo = log_min + step * std::max(best_index - 1, 0);
+    double hi = log_min + step * std::min(best_index + 1, grid_size - 1);
+    double x1 = hi - inv_phi * (hi - lo);
+    double x2 = lo + inv_phi * (hi - lo);
+    auto c1 = evaluate(std::exp(x1));
+    auto c2 = evaluate(std::exp(x2));
+
+    for (int i = 0; i < refine_iterations; ++i) {
+        if (is_better(c1, c2)) {
+            hi = x2;
+            x2 = x1, c2 = c1;
+            x1 = hi - inv_phi * (hi - lo);
+            c1 = evaluate(std::exp(x1));
+        }
+        else {
+            lo = x1;
+            x1 = x2, c1 = c2;
+            x2 = lo + inv_phi * (hi - lo);
+            c2 = evaluate(std::exp(x2));
+        }
+    }
+    for (const auto& candidate : { c1, c2 }) {
+        if (is_better(candidate, best)) {
+            best = candidate;
+        }
+    }
 
-    std::swap(optimized_data_, temp_layers_);
+    return SweepResult{
+        .params = { .offset = best.scale * minDistanceBetweenPlies_,
+                    .segment_len = best.max_distance * best.scale },
+        .width = best.box.width() * best.scale,
+        .height = best.box.height() * best.scale
+    };
 }
 
 void Interface::clear(){
     original_data_.clear();
     optimized_data_.clear();
+    columns_.clear();
+    sections_.clear();
+    core_anchors_.clear();
+    core_steps_.clear();
+    cleanup_report_ = {};
+    conversion_report_ = {};
+    profile_.clear();
+    node_stations_.clear();
+    regions_.clear();
+    params_ = {};
+    shifts_.clear();
+    nodes_order_.clear();
+    history_.clear();
+    history_pos_ = 0;
+    is_modified_ = false;
     width_= 0.;
     height_ = 0.;
     minDistanceBetweenPlies_ = 0.;
@@ -2,13 +2,150 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "common.h"
+#include "ls_cleanup.h"
+#include "ls_cores.h"
 #include "ls_data.h"
+#include "ls_diff.h"
+#include "ls_labels.h"
+#include "ls_profile.h"
+#include "persistent_array.h"
+#include "progress.h"
+
+namespace domain {
+
+// Разбивает сегменты слоя на группы с пересекающимися множествами кандидатов: candidates[i] - индексы
+// неиспользованных узлов (меньше 'unused_count'), которые может соединить сегмент i.
+// Группы независимы друг от друга и упорядочены по первому сегменту, сегменты внутри группы
+// упорядочены по возрастанию
+std::vector<std::vector<size_t>> GroupConflictingPlies(const std::vector<std::vector<size_t>>& candidates,
+                                                       size_t unused_count);
+
+} // namespace domain
 
 namespace ls {  // laminate sketch
 
+enum class ConversionStatus {
+    Completed,
+    TimedOut,   // Истекло время преобразования, эскиз содержит только выделенные до этого слои
+    Failed      // Не удалось выделить очередной слой, эскиз содержит только выделенные до этого слои
+};
+
+// Затраты времени преобразования на одну ломаную: построение пробной геометрии
+// и проверки на принадлежность верхнему слою
+struct PolylineCost {
+    domain::Point first;        // Концы ломаной в координатах исходного файла
+    domain::Point last;
+    size_t points_count = 0;
+    double seconds = 0.;
+};
+
+// Итог точного преобразования "сырого" эскиза
+struct ConversionReport {
+    // Наибольшее число ломаных в списке самых затратных
+    constexpr static size_t MaxExpensive = 5;
+
+    ConversionStatus status = ConversionStatus::Completed;
+    size_t total_polylines = 0;
+    size_t remaining_polylines = 0;         // Ломаные, не вошедшие в эскиз
+    size_t sections_count = 0;
+    size_t reused_sections = 0;             // Сечения, взятые из кэша без преобразования
+    std::vector<PolylineCost> expensive;    // Самые затратные ломаные по убыванию времени
+
+    bool isPartial() const noexcept { return status != ConversionStatus::Completed; }
+};
+
+// Результат точного преобразования "сырого" эскиза. Не зависит от параметров оптимизации
+struct ConvertedSketch {
+    LaminateData data;                      // Пустые данные - эскиз не удалось преобразовать
+    double minDistanceBetweenPlies = 0.;
+    std::vector<Column> columns;
+    std::vector<Section> sections;          // Независимые сечения в порядке слева направо с их положением в файле
+    std::vector<domain::Polygon> cores;     // Контуры заполнителей в координатах эскиза
+    domain::CleanupReport cleanup;          // Итог очистки "сырого" эскиза перед преобразованием
+    ConversionReport report;
+};
+
+// Приближенный эскиз для предварительного просмотра. Слои не связаны между собой
+// и не подходят ни для сохранения, ни для оптимизации
+struct PreviewSketch {
+    LaminateData data;
+    double width = 0.;
+    double height = 0.;
+};
+
+// Преобразованное сечение, сохраненное для повторного импорта
+struct CachedSection {
+    size_t points_count = 0;        // Число точек ломаных сечения - дополнительная проверка совпадения
+    domain::Point corner;           // Левый нижний угол ломаных сечения
+    ConvertedSketch sketch;         // Сечение без заполнителей
+};
+
+// Полностью преобразованные сечения последнего импорта по хешу их ломаных относительно
+// левого нижнего угла сечения. Изменение одной ломаной может изменить порядок выделения
+// всех слоев своего сечения, поэтому повторно используются только сечения целиком
+using SectionCache = std::unordered_map<size_t, CachedSection>;
+
+// Параметры оптимизации эскиза
+struct OptimizationParams {
+    double offset = 0.;
+    double segment_len = 0.;
+
+    bool operator==(const OptimizationParams&) const = default;
+};
+
+// Локальные параметры оптимизации участка эскиза - колонок с first_column по last_column включительно
+struct RegionParams {
+    size_t first_column = 0;
+    size_t last_column = 0;
+    OptimizationParams params;
+
+    bool operator==(const RegionParams&) const = default;
+};
+
+// Результат оптимизации эскиза, готовый к публикации в интерфейс
+struct OptimizedSketch {
+    LaminateData data;
+    double width = 0.;
+    double height = 0.;
+    OptimizationParams params;
+    std::vector<domain::Point> shifts;      // Накопленные смещения колонок при сжатии
+};
+
+// Состояние оптимизированного эскиза в истории изменений.
+// Координаты хранятся в неизменяемых массивах, разделяющих неизмененные блоки с соседними состояниями
+struct SketchSnapshot {
+    OptimizationParams params;
+    std::vector<RegionParams> regions;
+    double width = 0.;
+    double height = 0.;
+    domain::PersistentArray<domain::Point> points;  // Координаты узлов в порядке слоев, сегментов и узлов
+    domain::PersistentArray<domain::Point> shifts;  // Смещения колонок при сжатии
+};
+
+// Результат оптимизации для одной пары параметров перебора
+struct SweepResult {
+    OptimizationParams params;
+    double width = 0.;
+    double height = 0.;
+    domain::RawData sketch;  // Заполняется только при запросе эскизов
+};
+
+// Допустимые диапазоны параметров оптимизации
+struct ParamsLimits {
+    double min_offset = 0.;
+    double max_offset = 0.;
+    double min_segment_len = 0.;
+    double max_segment_len = 0.;
+};
+
 class Interface {
 public:
     const static int DefaultOffset = 1;
@@ -31,18 +168,155 @@ public:
     // Возвращает "сырой" эскиз для записи в dxf файл
     domain::RawData rawSketch() const;
 
+    // Итог очистки "сырого" эскиза при последнем преобразовании
+    const domain::CleanupReport& cleanupReport() const noexcept { return cleanup_report_; }
+
+    // Итог последнего точного преобразования: полнота результата и самые затратные ломаные
+    const ConversionReport& conversionReport() const noexcept { return conversion_report_; }
+
+    // Профиль числа слоев и толщины исходного эскиза по колонкам слева направо.
+    // Строится при преобразовании и не зависит от параметров оптимизации
+    const std::vector<domain::ProfileStation>& thicknessProfile() const noexcept { return profile_; }
+
+    // Станция профиля толщины в колонке узла 'node'. Для узла вне колонок - станция
+    // ближайшего по сегменту узла, входящего в колонку. Структура оптимизированного
+    // эскиза совпадает с исходной, поэтому подходят и позиции узлов текущего эскиза
+    std::optional<domain::ProfileStation> profileStationAt(NodePosition node) const;
+
+    // Сравнивает исходный эскиз как новую редакцию с преобразованной прежней редакцией 'before'.
+    // Редакции сравниваются в координатах исходных файлов, см. Section::origin
+    domain::SketchDiff diffWith(const ConvertedSketch& before) const;
+
+    // Линии измененных слоев для отображения в текущем (оптимизированном) эскизе
+    std::vector<domain::DiffHighlight> diffHighlights(const domain::SketchDiff& diff) const;
+
+    // Номера слоев с выносками для текущего эскиза
+    std::vector<domain::PlyLabel> plyLabels(double text_height) const;
+
+    // Контуры заполнителей в текущем эскизе с отступом от линий слоев
+    std::vector<domain::Polygon> cores() const;
+
     // Наполняет эскиз данными из "сырого" эскиза
     bool fillSketch(domain::RawData&& raw_sketch);
 
+    // Преобразует "сырой" эскиз не изменяя состояние интерфейса. Независимые сечения
+    // преобразуются параллельно и размещаются в результате слева направо.
+    // Может вызываться из рабочего потока; при запросе остановки возвращает std::nullopt.
+    // По истечении времени 'progress' или при ошибке выделения слоя возвращает частичный
+    // результат из уже выделенных верхних слоев, см. ConversionReport.
+    // Сечения, найденные в 'cache', не преобразуются заново; после преобразования
+    // кэш заменяется сечениями текущего эскиза
+    static std::optional<ConvertedSketch> convertSketch(domain::RawData&& raw_sketch,
+                                                        const domain::Progress& progress = {},
+                                                        SectionCache* cache = nullptr);
+
+    // Публикует преобразованный эскиз. Возвращает false, если эскиз пуст.
+    // Оптимизированный эскиз очищается до следующей оптимизации
+    bool setConverted(ConvertedSketch&& sketch);
+
+    // Публикует преобразованный эскиз вместе с оптимизированным по нему эскизом 'optimized',
+    // см. optimizeConverted, чтобы оптимизированные данные всегда соответствовали исходным.
+    // Возвращает false, если эскиз пуст
+    bool setConverted(ConvertedSketch&& sketch, OptimizedSketch&& optimized);
+
+    // Строит приближенный эскиз для предварительного просмотра, пока выполняется
+    // точное преобразование. Не изменяет состояние интерфейса: сохранение, сравнение
+    // и подбор параметров работают только с точно преобразованным эскизом
+    static PreviewSketch makePreview(const domain::RawData& raw_sketch, double offset, double segment_len);
+
     void scaleSketch(double scale);
 
     void optimizeSketch(double offset, double segment_len);
 
+    // Вычисляет оптимизированный эскиз не изменяя состояние интерфейса.
+    // Может вызываться из рабочего потока; при запросе остановки или по истечении
+    // времени 'progress' возвращает std::nullopt
+    std::optional<OptimizedSketch> makeOptimized(double offset, double segment_len,
+                                                 const domain::Progress& progress = {}) const;
+
+    // Оптимизирует еще не опубликованный преобразованный эскиз без локальных параметров участков.
+    // Может вызываться из рабочего потока; при запросе остановки, по истечении времени
+    // 'progress' или для пустого эскиза возвращает std::nullopt
+    static std::optional<OptimizedSketch> optimizeConverted(const ConvertedSketch& sketch, double offset,
+                                                            double segment_len,
+                                                            const domain::Progress& progress = {});
+
+    // Публикует ранее вычисленный оптимизированный эскиз
+    void setOptimized(OptimizedSketch&& sketch);
+
+    // Общие параметры опубликованного оптимизированного эскиза
+    const OptimizationParams& params() const noexcept { return params_; }
+
+    size_t columnsCount() const noexcept { return columns_.size(); }
+
+    // Возвращает первую и последнюю колонки, нижние узлы которых в оптимизированном
+    // эскизе лежат между 'left' и 'right'. std::nullopt - в диапазоне нет колонок
+    std::optional<std::pair<size_t, size_t>> columnsInRange(double left, double right) const;
+
+    // Задает локальные параметры участка поверх общих и ранее заданных. Пересчитываются
+    // только колонки участка, эскиз правее участка смещается целиком.
+    // Возвращает false, если участок или параметры недопустимы
+    bool setRegionParams(const RegionParams& region);
+
+    // Удаляет локальные параметры участков. Изменения вступают в силу при следующей оптимизации
+    void clearRegions() { regions_.clear(); }
+
+    const std::vector<RegionParams>& regions() const noexcept { return regions_; }
+
+    // Наибольшее число сохраненных состояний в истории изменений
+    constexpr static size_t MaxHistorySize = 100;
+
+    // Сохраняет текущее состояние оптимизированного эскиза в историю, если оно изменилось
+    // после последнего сохранения. Отмененные состояния удаляются из истории.
+    // При 'replace_last' заменяет последнее сохраненное состояние (например, при
+    // непрерывном изменении параметров), если оно не является единственным
+    void commit(bool replace_last = false);
+
+    bool canUndo() const noexcept { return history_pos_ > 0; }
+    bool canRedo() const noexcept { return history_pos_ + 1 < history_.size(); }
+
+    // Восстанавливают предыдущее и следующее состояния истории без повторной оптимизации.
+    // Время пропорционально числу изменившихся узлов. Возвращают false, если переход невозможен
+    bool undo();
+    bool redo();
+
+    // Параллельно оптимизирует эскиз для каждой пары параметров из 'grid'.
+    // Порядок результатов совпадает с порядком параметров. При 'with_sketches'
+    // в результаты добавляются "сырые" эскизы для записи в dxf файл
+    std::vector<SweepResult> sweepParameters(const std::vector<OptimizationParams>& grid,
+                                             bool with_sketches = false) const;
+
+    // Подбирает параметры в пределах 'limits', при которых эскиз помещается в лист
+    // sheet_width x sheet_height с наибольшим расстоянием между слоями.
+    // Локальные параметры участков при подборе не учитываются.
+    // Возвращает std::nullopt если эскиз не помещается ни при каких допустимых параметрах,
+    // а также при неположительных размерах листа или пределах и при минимуме больше максимума
+    std::optional<SweepResult> autoFit(double sheet_width, double sheet_height,
+                                       const ParamsLimits& limits) const;
+
     void clear();
 
 private:
+    void restore(size_t history_pos);
+
     LaminateData original_data_;
     LaminateData optimized_data_;
+    std::vector<Column> columns_;           // Колонки исходного эскиза в порядке обхода
+    std::vector<Section> sections_;
+    std::vector<domain::CoreAnchors> core_anchors_; // Привязка контуров заполнителей к исходному эскизу
+    std::vector<double> core_steps_;        // Наименьшие расстояния между колонками, сохраняющие заполнители
+    domain::CleanupReport cleanup_report_;
+    ConversionReport conversion_report_;
+    std::vector<domain::ProfileStation> profile_;   // Профиль толщины исходного эскиза
+    std::unordered_map<std::uint64_t, size_t> node_stations_;  // Станция профиля по позиции узла колонки
+    std::vector<RegionParams> regions_;     // Более поздние участки перекрывают ранние
+    OptimizationParams params_;             // Общие параметры оптимизированного эскиза
+    std::vector<domain::Point> shifts_;     // Смещения колонок оптимизированного эскиза
+
+    std::vector<NodePosition> nodes_order_; // Позиции узлов в порядке хранения координат в истории
+    std::deque<SketchSnapshot> history_;
+    size_t history_pos_ = 0;                // Индекс текущего состояния в истории
+    bool is_modified_ = false;              // Эскиз изменен после последнего сохранения в историю
     double width_;
     double height_;
     double minDistanceBetweenPlies_;
@@ -0,0 +1,180 @@
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <tuple>
+
+#include "ls_labels.h"
+
+namespace domain {
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+using IndexPoint = bg::model::point<double, 2, bg::cs::cartesian>;
+using IndexBox = bg::model::box<IndexPoint>;
+using IndexSegment = bg::model::segment<IndexPoint>;
+
+using SegmentsTree = bgi::rtree<IndexSegment, bgi::rstar<16>>;
+using BoxesTree = bgi::rtree<IndexBox, bgi::rstar<16>>;
+
+namespace {
+
+IndexPoint ToIndex(const Point& point) {
+    return { point.x, point.y };
+}
+
+// Точка сегмента на середине его длины
+Point GetPlyMiddle(const ls::Ply& ply) {
+    double length = 0.;
+    for (size_t i = 1; i < ply.size(); ++i) {
+        length += DistanceBetweenPoints(ply[i - 1].point, ply[i].point);
+    }
+
+    double remain = length / 2.;
+    for (size_t i = 1; i < ply.size(); ++i) {
+        const double part = DistanceBetweenPoints(ply[i - 1].point, ply[i].point);
+        if (remain <= part && part > 0.) {
+            const double t = remain / part;
+            return { ply[i - 1].point.x + (ply[i].point.x - ply[i - 1].point.x) * t,
+                     ply[i - 1].point.y + (ply[i].point.y - ply[i - 1].point.y) * t };
+        }
+        remain -= part;
+    }
+    return ply.firstNode().point;
+}
+
+template <typename Tree, typename Geometry>
+bool HasIntersections(const Tree& tree, const Geometry& geometry) {
+    return tree.qbegin(bgi::intersects(geometry)) != tree.qend();
+}
+
+} // namespace
+
+std::vector<PlyLabel> PlacePlyLabels(const ls::LaminateData& layers, double text_height) {
+    std::vector<PlyLabel> result;
+    if (layers.isEmpty() || text_height <= 0.) {
+        return result;
+    }
+
+    // Отрезки эскиза загружаются в дерево одним пакетом
+    std::vector<IndexSegment> segments;
+    BoundingBox sketch_box;
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            for (size_t i = 0; i < ply.size(); ++i) {
+                sketch_box.extend(ply[i].point);
+                if (i != 0) {
+                    segments.emplace_back(ToIndex(ply[i - 1].point), ToIndex(ply[i].point));
+                }
+            }
+        }
+    }
+    const SegmentsTree lines(segments.begin(), segments.end());
+
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            result.push_back(PlyLabel{
+                .anchor = GetPlyMiddle(ply),
+                .text = std::to_string(ply.firstNode().position.layerPos + 1),
+                .height = text_height
+            });
+        }
+    }
+    // Расстановка слева направо, на одной вертикали - снизу вверх
+    std::sort(result.begin(), result.end(), [](const PlyLabel& lhs, const PlyLabel& rhs) {
+        return std::tie(lhs.anchor.x, lhs.anchor.y) < std::tie(rhs.anchor.x, rhs.anchor.y);
+    });
+
+    BoxesTree placed_texts;
+    SegmentsTree placed_leaders;
+    // Правые границы текстов в рядах над и под эскизом
+    std::vector<double> rows_above;
+    std::vector<double> rows_below;
+
+    const double gap = text_height * 0.25;
+    // Кандидаты удаляются от эскиза до выхода за его габарит по высоте
+    const int max_steps = std::clamp(static_cast<int>(std::ceil(sketch_box.height() / text_height)) + 4, 4, 512);
+    const double row_length = std::max(sketch_box.width() / 8., text_height * 20.);
+
+    for (auto& label : result) {
+        const double width = LabelTextWidth(label.text, text_height);
+
+        struct Candidate {
+            Point leader_end;
+            IndexBox box;
+        };
+
+        auto make_candidate = [&](double dx, double dy) {
+            const Point end{ label.anchor.x + dx, label.anchor.y + dy };
+            const double left = (dx >= 0.) ? end.x + gap : end.x - gap - width;
+            return Candidate{
+                .leader_end = end,
+                .box = IndexBox({ left, end.y - text_height / 2. }, { left + width, end.y + text_height / 2. })
+            };
+        };
+
+        auto is_free = [&](const Candidate& candidate) {
+            const IndexSegment leader(ToIndex(label.anchor), ToIndex(candidate.leader_end));
+            return !HasIntersections(lines, candidate.box)
+                   && !HasIntersections(placed_texts, candidate.box)
+                   && !HasIntersections(placed_leaders, candidate.box)
+                   && !HasIntersections(placed_texts, leader);
+        };
+
+        // Более короткие выноски предпочтительнее; наклон 45 градусов, затем крутой
+        std::optional<Candidate> best;
+        for (int step = 1; step <= max_steps && !best; ++step) {
+            const double distance = step * text_height;
+            for (const double dy : { distance, -distance }) {
+                for (const double dx : { distance, -distance, text_height, -text_height }) {
+                    const auto candidate = make_candidate(dx, dy);
+                    if (is_free(candidate)) {
+                        best = candidate;
+                        break;
+                    }
+                }
+                if (best) {
+                    break;
+                }
+            }
+        }
+
+        // Свободного места рядом нет: текст выносится в ряды над или под эскизом (ближе к якорю).
+        // В каждом ряду тексты идут слева направо, ряд заполняется, пока текст не отходит от якоря
+        // дальше, чем на длину ряда
+        const Candidate chosen = best ? *best : [&] {
+            const bool above = label.anchor.y >= (sketch_box.bottom + sketch_box.top) / 2.;
+            auto& rows_right = above ? rows_above : rows_below;
+            for (size_t row = 0;; ++row) {
+                if (row == rows_right.size()) {
+                    rows_right.push_back(-std::numeric_limits<double>::infinity());
+                }
+                const double left = std::max(label.anchor.x + gap, rows_right[row] + gap);
+                const double shift = (static_cast<double>(row) + 2.) * text_height * 1.5;
+                const double center = above ? sketch_box.top + shift : sketch_box.bottom - shift;
+                const Candidate candidate{
+                    .leader_end = { left - gap, center },
+                    .box = IndexBox({ left, center - text_height / 2. }, { left + width, center + text_height / 2. })
+                };
+                if (left - label.anchor.x <= row_length && !HasIntersections(placed_texts, candidate.box)) {
+                    rows_right[row] = left + width;
+                    return candidate;
+                }
+            }
+        }();
+
+        label.leader_end = chosen.leader_end;
+        label.position = { chosen.box.min_corner().get<0>(), chosen.box.min_corner().get<1>() };
+
+        placed_texts.insert(chosen.box);
+        placed_leaders.insert(IndexSegment(ToIndex(label.anchor), ToIndex(label.leader_end)));
+    }
+
+    return result;
+}
+
+} // namespace domain
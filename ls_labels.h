@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "ls_data.h"
+
+namespace domain {
+
+// Выноска с номером слоя
+struct PlyLabel {
+    Point anchor;           // Точка на сегменте слоя, от которой начинается линия выноски
+    Point leader_end;       // Конец линии выноски у текста
+    Point position;         // Левая нижняя точка текста
+    std::string text;
+    double height = 0.;     // Высота текста
+};
+
+// Ширина текста выноски с запасом для стандартного шрифта
+inline double LabelTextWidth(const std::string& text, double height) {
+    return static_cast<double>(text.size()) * height * 0.8;
+}
+
+// Расставляет номера слоев (снизу вверх, начиная с 1) на каждый сегмент эскиза.
+// Тексты не пересекают линии эскиза, другие тексты и выноски; выноски не пересекают тексты.
+// Если свободного места рядом с сегментом нет, текст выносится в ряды над или под эскизом.
+// Поиск места использует R-деревья отрезков эскиза, текстов и выносок: время O(n log n)
+std::vector<PlyLabel> PlacePlyLabels(const ls::LaminateData& layers, double text_height);
+
+} // namespace domain
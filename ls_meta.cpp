@@ -0,0 +1,53 @@
+#include "ls_meta.h"
+
+namespace domain {
+
+size_t PlyMetaTable::RecordHash::operator()(const Record& record) const noexcept {
+    size_t hash = 0;
+    for (const auto index : record) {
+        hash ^= std::hash<std::uint32_t>{}(index) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+std::uint32_t PlyMetaTable::internString(std::string_view value) {
+    if (const auto it = string_ids_.find(value); it != string_ids_.end()) {
+        return it->second;
+    }
+    const auto index = static_cast<std::uint32_t>(strings_.size());
+    string_ids_.emplace(strings_.emplace_back(value), index);
+    return index;
+}
+
+PlyMetaId PlyMetaTable::intern(const PlyMeta& meta) {
+    const Record record{ internString(meta.layer), internString(meta.material),
+                         internString(meta.ply_id), internString(meta.handle) };
+
+    if (const auto it = record_ids_.find(record); it != record_ids_.end()) {
+        return it->second;
+    }
+    records_.push_back(record);
+    const auto id = static_cast<PlyMetaId>(records_.size());
+    record_ids_.emplace(record, id);
+    return id;
+}
+
+PlyMeta PlyMetaTable::get(PlyMetaId id) const {
+    if (id == NoPlyMeta || id > records_.size()) {
+        return {};
+    }
+    const Record& record = records_[id - 1];
+    return PlyMeta{ .layer = std::string(stringAt(record[0])),
+                    .material = std::string(stringAt(record[1])),
+                    .ply_id = std::string(stringAt(record[2])),
+                    .handle = std::string(stringAt(record[3])) };
+}
+
+std::string_view PlyMetaTable::layer(PlyMetaId id) const {
+    if (id == NoPlyMeta || id > records_.size()) {
+        return {};
+    }
+    return stringAt(records_[id - 1][0]);
+}
+
+} // namespace domain
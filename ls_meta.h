@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+namespace domain {
+
+// Данные исходного слоя, сохраняемые для прослеживаемости результата
+struct PlyMeta {
+    std::string layer;      // Имя слоя исходного файла
+    std::string material;
+    std::string ply_id;     // Обозначение слоя укладки
+    std::string handle;     // Дескриптор примитива исходного файла
+
+    bool operator==(const PlyMeta&) const = default;
+};
+
+// Таблица данных исходных слоев. Ломаные и сегменты хранят только номер записи (PlyMetaId),
+// строки хранятся в таблице по одному экземпляру: совпадающие строки разных записей
+// и совпадающие записи не дублируются.
+// Таблица только пополняется, поэтому номера остаются действительными при повторном импорте
+class PlyMetaTable {
+public:
+    // Возвращает номер записи 'meta', добавляя ее при необходимости
+    PlyMetaId intern(const PlyMeta& meta);
+
+    // Запись с номером 'id'. Для NoPlyMeta и неизвестных номеров - пустая запись
+    PlyMeta get(PlyMetaId id) const;
+
+    // Имя исходного слоя записи 'id', пустая строка - данных нет
+    std::string_view layer(PlyMetaId id) const;
+
+    size_t size() const noexcept { return records_.size(); }
+
+private:
+    using Record = std::array<std::uint32_t, 4>;   // Номера строк полей записи
+
+    struct RecordHash {
+        size_t operator()(const Record& record) const noexcept;
+    };
+
+    std::uint32_t internString(std::string_view value);
+    std::string_view stringAt(std::uint32_t index) const { return strings_[index]; }
+
+    std::deque<std::string> strings_;       // Адреса строк не меняются при добавлении
+    std::unordered_map<std::string_view, std::uint32_t> string_ids_;
+    std::vector<Record> records_;           // Запись с номером id хранится в records_[id - 1]
+    std::unordered_map<Record, PlyMetaId, RecordHash> record_ids_;
+};
+
+} // namespace domain
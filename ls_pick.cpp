@@ -0,0 +1,95 @@
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include <cmath>
+#include <iterator>
+#include <vector>
+
+#include "ls_pick.h"
+
+namespace domain {
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+using IndexPoint = bg::model::point<double, 2, bg::cs::cartesian>;
+using IndexSegment = bg::model::segment<IndexPoint>;
+
+// Отрезок слоя и позиции узлов его концов
+struct PickValue {
+    IndexSegment segment;
+    ls::NodePosition first;
+    ls::NodePosition last;
+};
+
+struct PickIndexable {
+    using result_type = const IndexSegment&;
+    result_type operator()(const PickValue& value) const { return value.segment; }
+};
+
+struct PickEqual {
+    bool operator()(const PickValue& lhs, const PickValue& rhs) const {
+        return lhs.first == rhs.first && lhs.last == rhs.last;
+    }
+};
+
+struct PlyPicker::Tree {
+    using RTree = bgi::rtree<PickValue, bgi::rstar<16>, PickIndexable, PickEqual>;
+    RTree rtree;
+};
+
+PlyPicker::PlyPicker() = default;
+PlyPicker::PlyPicker(PlyPicker&&) noexcept = default;
+PlyPicker& PlyPicker::operator=(PlyPicker&&) noexcept = default;
+PlyPicker::~PlyPicker() = default;
+
+PlyPicker::PlyPicker(const std::vector<ls::Layer>& layers) {
+    std::vector<PickValue> values;
+    for (const auto& layer : layers) {
+        for (const auto& ply : layer) {
+            for (size_t i = 1; i < ply.size(); ++i) {
+                const Point& a = ply[i - 1].point;
+                const Point& b = ply[i].point;
+                // Бесконечные координаты нарушают границы узлов дерева
+                if (!std::isfinite(a.x) || !std::isfinite(a.y) || !std::isfinite(b.x) || !std::isfinite(b.y)) {
+                    continue;
+                }
+                values.push_back(PickValue{
+                    .segment = IndexSegment({ a.x, a.y }, { b.x, b.y }),
+                    .first = ply[i - 1].position,
+                    .last = ply[i].position
+                });
+            }
+        }
+    }
+    // Пакетная загрузка строит более сбалансированное дерево, чем вставка по одному
+    tree_ = std::make_unique<Tree>(Tree{ .rtree = Tree::RTree(values.begin(), values.end()) });
+}
+
+bool PlyPicker::isEmpty() const noexcept {
+    return !tree_ || tree_->rtree.empty();
+}
+
+std::optional<PlyPick> PlyPicker::pick(const Point& point, double tolerance) const {
+    if (isEmpty()) {
+        return std::nullopt;
+    }
+
+    const IndexPoint target(point.x, point.y);
+    std::vector<PickValue> nearest;
+    tree_->rtree.query(bgi::nearest(target, 1), std::back_inserter(nearest));
+    if (nearest.empty()) {
+        return std::nullopt;
+    }
+
+    const PickValue& value = nearest.front();
+    const double distance = bg::distance(target, value.segment);
+    if (distance > tolerance) {
+        return std::nullopt;
+    }
+
+    const bool is_first = bg::distance(target, value.segment.first) <= bg::distance(target, value.segment.second);
+    return PlyPick{ .node = is_first ? value.first : value.last, .distance = distance };
+}
+
+} // namespace domain
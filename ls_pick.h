@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "common.h"
+#include "ls_data.h"
+
+namespace domain {
+
+// Слой эскиза под курсором: ближайший к точке узел и расстояние до линии слоя
+struct PlyPick {
+    ls::NodePosition node;
+    double distance = 0.;
+};
+
+// Пространственный индекс отрезков слоев для поиска слоя под курсором.
+// Отрезки загружаются в R-дерево один раз, время построения O(n log n),
+// время запроса O(log n) по числу отрезков n
+class PlyPicker {
+public:
+    PlyPicker();
+    explicit PlyPicker(const std::vector<ls::Layer>& layers);
+    PlyPicker(PlyPicker&&) noexcept;
+    PlyPicker& operator=(PlyPicker&&) noexcept;
+    ~PlyPicker();
+
+    bool isEmpty() const noexcept;
+
+    // Слой, линия которого проходит ближе всего к 'point', но не дальше 'tolerance'.
+    // Из двух концов ближайшего отрезка выбирается ближний к 'point'
+    std::optional<PlyPick> pick(const Point& point, double tolerance) const;
+
+private:
+    struct Tree;
+    std::unique_ptr<Tree> tree_;
+};
+
+} // namespace domain
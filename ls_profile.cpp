@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "ls_profile.h"
+
+namespace domain {
+
+std::vector<ProfileStation> BuildThicknessProfile(const ls::LaminateData& layers,
+                                                  const std::vector<ls::Column>& columns,
+                                                  const std::vector<ls::Section>& sections,
+                                                  double ply_thickness) {
+    std::vector<ProfileStation> result;
+    result.reserve(columns.size());
+
+    size_t section = 0;
+    for (size_t index = 0; index < columns.size(); ++index) {
+        const auto& column = columns[index];
+        if (column.empty()) {
+            continue;
+        }
+        while (section + 1 < sections.size() && sections[section + 1].firstColumn <= index) {
+            ++section;
+        }
+
+        // Расстояние между линиями слоев вдоль колонки; к нему добавляется среднее расстояние
+        // между слоями этой колонки - по половине слоя снизу и сверху
+        double height = 0.;
+        for (size_t i = 1; i < column.size(); ++i) {
+            height += DistanceBetweenPoints(layers.getNode(column[i - 1]).point, layers.getNode(column[i]).point);
+        }
+        const double spacing = (column.size() > 1) ? height / static_cast<double>(column.size() - 1) : ply_thickness;
+
+        ProfileStation& station = result.emplace_back(ProfileStation{
+            .section = section,
+            .column = index,
+            .x = layers.getNode(column.front()).point.x + (sections.empty() ? 0. : sections[section].origin.x),
+            .plies = column.size(),
+            .thickness = height + spacing
+        });
+
+        for (const auto pos : column) {
+            switch (layers.getLayer(pos.layerPos).getPly(pos.plyPos).orientation) {
+            case Orientation::Zero: ++station.zero; break;
+            case Orientation::Perpendicular: ++station.perpendicular; break;
+            default: ++station.other; break;
+            }
+        }
+    }
+
+    // Колонки перечисляются в порядке обхода слоев, а не по длине детали: сбросы вычисляются
+    // между соседними по x станциями одного сечения, у первой станции сечения сброса нет
+    std::stable_sort(result.begin(), result.end(), [](const ProfileStation& lhs, const ProfileStation& rhs) {
+        return lhs.section != rhs.section ? lhs.section < rhs.section : lhs.x < rhs.x;
+    });
+    for (size_t i = 1; i < result.size(); ++i) {
+        if (result[i - 1].section == result[i].section) {
+            result[i].drop = static_cast<int>(result[i].plies) - static_cast<int>(result[i - 1].plies);
+        }
+    }
+    return result;
+}
+
+void WriteProfileCsv(const std::vector<ProfileStation>& profile, std::ostream& out) {
+    out << "section,x,plies,thickness,zero,perpendicular,other,drop\n";
+    out << std::fixed << std::setprecision(4);
+    for (const auto& station : profile) {
+        out << station.section << ',' << station.x << ',' << station.plies << ',' << station.thickness << ','
+            << station.zero << ',' << station.perpendicular << ',' << station.other << ',' << station.drop << '\n';
+    }
+}
+
+std::vector<ProfileStation> GetProfileKeyStations(const std::vector<ProfileStation>& profile) {
+    std::vector<ProfileStation> result;
+    for (size_t i = 0; i < profile.size(); ++i) {
+        const bool is_first = (i == 0 || profile[i - 1].section != profile[i].section);
+        const bool is_last = (i + 1 == profile.size() || profile[i + 1].section != profile[i].section);
+        if (is_first || is_last || profile[i].drop != 0) {
+            result.push_back(profile[i]);
+        }
+    }
+    return result;
+}
+
+} // namespace domain
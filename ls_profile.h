@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "ls_data.h"
+
+namespace domain {
+
+// Станция профиля толщины - колонка исходного эскиза
+struct ProfileStation {
+    size_t section = 0;         // Номер независимого сечения
+    size_t column = 0;          // Номер колонки исходного эскиза
+    double x = 0.;              // Положение по длине (по нижнему узлу колонки) в координатах исходного файла, мм
+    size_t plies = 0;           // Число слоев
+    double thickness = 0.;      // Толщина пакета по расстояниям между слоями колонки, мм
+    size_t zero = 0;            // Слои 0
+    size_t perpendicular = 0;   // Слои 90
+    size_t other = 0;           // Слои +-45 и другие
+    int drop = 0;               // Изменение числа слоев относительно предыдущей по x станции сечения
+};
+
+// Строит профиль числа слоев и толщины за один проход по колонкам. Станции упорядочены
+// по сечениям и по x внутри сечения. Сечения размещаются в эскизе иначе, чем в файле,
+// поэтому x переводится в координаты исходного файла по Section::origin своего сечения.
+// Время O(n + k log k) по числу узлов n и колонок k.
+// Профиль строится по исходному эскизу и не зависит от параметров оптимизации.
+// Толщина - длина колонки от нижней до верхней линии слоя плюс среднее расстояние между
+// соседними линиями этой колонки: линии слоев проходят по их серединам. Для колонки
+// из одного слоя вместо среднего расстояния берется 'ply_thickness'
+std::vector<ProfileStation> BuildThicknessProfile(const ls::LaminateData& layers,
+                                                  const std::vector<ls::Column>& columns,
+                                                  const std::vector<ls::Section>& sections,
+                                                  double ply_thickness);
+
+// Записывает профиль в формате CSV
+void WriteProfileCsv(const std::vector<ProfileStation>& profile, std::ostream& out);
+
+// Станции, на которых меняется число слоев (сбросы), а также первая и последняя станции сечений
+std::vector<ProfileStation> GetProfileKeyStations(const std::vector<ProfileStation>& profile);
+
+} // namespace domain
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+
+#include "ls_synth.h"
+
+namespace domain {
+
+namespace {
+
+// Точки ближе этого расстояния по длине сечения считаются совпадающими, мм
+constexpr double BreakpointPrecision = 1e-9;
+
+// Верхняя поверхность пакета - ломаная с возрастающими абсциссами
+class Surface {
+public:
+    Surface(double length, double sag, double step) {
+        const size_t count = std::max<size_t>(2, static_cast<size_t>(std::ceil(length / step)) + 1);
+        points_.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const double x = length * static_cast<double>(i) / static_cast<double>(count - 1);
+            // Поверхность оснастки - парабола с прогибом 'sag' в середине сечения
+            points_.push_back({ x, 4. * sag * x * (length - x) / (length * length) });
+        }
+    }
+
+    // Добавляет точку излома поверхности, если ее еще нет. Точки вне поверхности не добавляются
+    void insertBreakpoint(double x) {
+        const auto it = std::lower_bound(points_.begin(), points_.end(), x - BreakpointPrecision,
+                                         [](const Point& point, double value) { return point.x < value; });
+        if (it == points_.begin() || it == points_.end() || std::abs(it->x - x) <= BreakpointPrecision) {
+            return;
+        }
+        const Point& a = *std::prev(it);
+        const Point& b = *it;
+        const double t = (x - a.x) / (b.x - a.x);
+        points_.insert(it, Point{ x, a.y + (b.y - a.y) * t });
+    }
+
+    // Линия слоя, лежащего на поверхности на участке [first, last]
+    Polyline slice(double first, double last) {
+        insertBreakpoint(first);
+        insertBreakpoint(last);
+        Polyline result;
+        for (const auto& point : points_) {
+            if (point.x >= first - BreakpointPrecision && point.x <= last + BreakpointPrecision) {
+                result.push_back(point);
+            }
+        }
+        return result;
+    }
+
+    // Поднимает поверхность на толщину слоя с участком [first, last]. За пределами
+    // оборванного края поверхность спускается на длине 'ramp'
+    void addPly(double first, double last, bool is_left_dropped, bool is_right_dropped,
+                double thickness, double ramp) {
+        if (is_left_dropped) {
+            insertBreakpoint(first - ramp);
+        }
+        if (is_right_dropped) {
+            insertBreakpoint(last + ramp);
+        }
+        for (auto& point : points_) {
+            double coverage = 1.;
+            if (is_left_dropped) {
+                coverage = std::min(coverage, std::clamp((point.x - first + ramp) / ramp, 0., 1.));
+            }
+            if (is_right_dropped) {
+                coverage = std::min(coverage, std::clamp((last + ramp - point.x) / ramp, 0., 1.));
+            }
+            point.y += thickness * coverage;
+        }
+    }
+
+private:
+    std::vector<Point> points_;
+};
+
+// Случайные величины выводятся прямо из последовательности std::mt19937, которая задана стандартом.
+// Алгоритмы std::shuffle и распределений стандартом не заданы, и с ними одно зерно давало бы
+// разные эскизы в разных стандартных библиотеках
+
+// Равномерно распределенное число в [0, 1)
+double UniformReal(std::mt19937& rng) {
+    constexpr double Range = static_cast<double>(std::mt19937::max()) + 1.;
+    return static_cast<double>(rng()) / Range;
+}
+
+// Равномерно распределенный индекс в [0, count)
+size_t UniformIndex(std::mt19937& rng, size_t count) {
+    return std::min(count - 1, static_cast<size_t>(UniformReal(rng) * static_cast<double>(count)));
+}
+
+// Истина с вероятностью 'probability'
+bool Bernoulli(std::mt19937& rng, double probability) {
+    return UniformReal(rng) < probability;
+}
+
+// Индекс, выбранный с вероятностью, пропорциональной его весу. Отрицательные веса считаются нулевыми,
+// при нулевой сумме весов выбирается первый индекс
+template <size_t Count>
+size_t WeightedIndex(std::mt19937& rng, const std::array<double, Count>& weights) {
+    double total = 0.;
+    for (const double weight : weights) {
+        total += std::max(weight, 0.);
+    }
+    double threshold = UniformReal(rng) * total;
+    for (size_t i = 0; i < Count; ++i) {
+        const double weight = std::max(weights[i], 0.);
+        if (threshold < weight) {
+            return i;
+        }
+        threshold -= weight;
+    }
+    // Ошибки округления: последний индекс с ненулевым весом
+    for (size_t i = Count; i > 0; --i) {
+        if (weights[i - 1] > 0.) {
+            return i - 1;
+        }
+    }
+    return 0;
+}
+
+// Положения обрывов слоев в краевой зоне длиной 'zone': равномерно расставленные ступени,
+// случайно распределенные между обрывающимися слоями
+std::vector<double> StaggerDrops(size_t count, double zone, std::mt19937& rng) {
+    std::vector<double> result(count);
+    for (size_t i = 0; i < count; ++i) {
+        result[i] = zone * static_cast<double>(i + 1) / static_cast<double>(count + 1);
+    }
+    // Перемешивание Фишера - Йетса
+    for (size_t i = count; i > 1; --i) {
+        std::swap(result[i - 1], result[UniformIndex(rng, i)]);
+    }
+    return result;
+}
+
+void GenerateSection(const LaminateSpec& spec, double shift, std::mt19937& rng, RawData& result) {
+    const size_t count = spec.plies_count;
+
+    // Нижний и верхний слои всегда проходят сечение целиком
+    const double drop_share = std::clamp(spec.drop_share, 0., 1.);
+    std::vector<bool> dropped(count, false);
+    for (size_t i = 1; i + 1 < count; ++i) {
+        dropped[i] = Bernoulli(rng, drop_share);
+    }
+    const size_t drops_count = static_cast<size_t>(std::count(dropped.begin(), dropped.end(), true));
+
+    const double zone = spec.length * std::clamp(spec.ramp_share, 0., 0.5);
+    const auto left_drops = StaggerDrops(drops_count, zone, rng);
+    const auto right_drops = StaggerDrops(drops_count, zone, rng);
+
+    const OrientationMix& mix = spec.orientations;
+    const std::array<double, 3> weights{ mix.zero, mix.perpendicular, mix.other };
+    constexpr Orientation Orientations[] = { Orientation::Zero, Orientation::Perpendicular, Orientation::Other };
+
+    Surface surface(spec.length, spec.sag, spec.point_step);
+    size_t drop = 0;
+    for (size_t i = 0; i < count; ++i) {
+        double first = 0.;
+        double last = spec.length;
+        if (dropped[i]) {
+            first = left_drops[drop];
+            last = spec.length - right_drops[drop];
+            ++drop;
+        }
+
+        RawPolyline& ply = result.emplace_back();
+        ply.orientation = Orientations[WeightedIndex(rng, weights)];
+        ply.polyline = surface.slice(first, last);
+        for (auto& point : ply.polyline) {
+            point.x += shift;
+        }
+        if (Bernoulli(rng, 0.5)) {
+            std::reverse(ply.polyline.begin(), ply.polyline.end());
+        }
+
+        surface.addPly(first, last, dropped[i], dropped[i], spec.ply_thickness, spec.ramp_length);
+    }
+}
+
+} // namespace
+
+RawData GenerateLaminate(const LaminateSpec& spec) {
+    RawData result;
+    if (spec.plies_count == 0 || spec.length <= 0. || spec.point_step <= 0. || spec.ramp_length <= 0.) {
+        return result;
+    }
+
+    std::mt19937 rng(spec.seed);
+    // Промежуток между сечениями исключает их касание
+    const double gap = spec.length * 0.2 + std::abs(spec.sag);
+    for (size_t section = 0; section < spec.sections_count; ++section) {
+        GenerateSection(spec, static_cast<double>(section) * (spec.length + gap), rng, result);
+    }
+    return result;
+}
+
+} // namespace domain
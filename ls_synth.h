@@ -0,0 +1,38 @@
+#pragma once
+
+#include "common.h"
+
+namespace domain {
+
+// Доли направлений укладки слоев. Нормируются при генерации
+struct OrientationMix {
+    double zero = 0.4;
+    double perpendicular = 0.2;
+    double other = 0.4;         // +-45 и другие
+};
+
+// Параметры синтетического сечения слоистой конструкции
+struct LaminateSpec {
+    size_t plies_count = 100;       // Слоев в одном сечении
+    size_t sections_count = 1;      // Независимых сечений, размещаемых слева направо
+    unsigned seed = 1;
+    double length = 300.;           // Длина сечения, мм
+    double ply_thickness = 0.25;    // Расстояние между линиями соседних слоев, мм
+    double drop_share = 0.5;        // Доля слоев, обрывающихся внутри сечения
+    double ramp_share = 0.3;        // Доля длины сечения с каждого края, на которой обрываются слои
+    double ramp_length = 4.;        // Длина спуска вышележащих слоев над обрывом, мм
+    double sag = 10.;               // Прогиб поверхности оснастки в середине сечения, мм. Ноль - плоская оснастка
+    double point_step = 5.;         // Шаг точек линий слоев, мм
+    OrientationMix orientations;
+};
+
+// Строит "сырой" эскиз синтетического сечения: слои укладываются снизу вверх на
+// изогнутую поверхность оснастки, каждый следующий слой повторяет поверхность пакета.
+// Обрывающиеся слои заканчиваются ступенями в краевых зонах, вышележащие слои
+// спускаются над обрывом на длине 'ramp_length'. Направления обхода ломаных
+// случайны, как в файлах DXF. Результат полностью определяется параметрами и зерном
+// и не зависит от стандартной библиотеки: используется только последовательность std::mt19937.
+// Время пропорционально числу слоев и числу точек поверхности пакета
+RawData GenerateLaminate(const LaminateSpec& spec);
+
+} // namespace domain
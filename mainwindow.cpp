@@ -3,20 +3,31 @@
 
 #include <QIcon>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QString>
 #include <QMessageBox>
 #include <QComboBox>
 #include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QFormLayout>
+#include <QMouseEvent>
+#include <QSignalBlocker>
+#include <QStringList>
 
-void Sketch::create(QRect window)
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+void Sketch::createLayers(const std::vector<ls::Layer>& layers, double width, double height, QRect window)
 {
     const int pixPerMm = MainWindow::PixInCm / 10;
 
-    m_width = static_cast<int>(m_interface.width() * pixPerMm);
-    m_height = static_cast<int>(m_interface.height() * pixPerMm);
+    m_width = static_cast<int>(width * pixPerMm);
+    m_height = static_cast<int>(height * pixPerMm);
     setOrigin(window);
 
-    for (const auto& layer : m_interface.sketchLayers()) {
+    for (const auto& layer : layers) {
         for (const auto& ply : layer) {
             auto& newLayer = m_layers.emplace_back(Layer{});
 
@@ -42,8 +53,79 @@ void Sketch::create(QRect window)
     }
 }
 
+void Sketch::createPreview(const ls::PreviewSketch& preview, QRect window)
+{
+    const domain::StageTimer timer("sketch");
+    createLayers(preview.data.getData(), preview.width, preview.height, window);
+}
+
+void Sketch::create(QRect window)
+{
+    const domain::StageTimer timer("sketch");
+    const int pixPerMm = MainWindow::PixInCm / 10;
+
+    createLayers(m_interface.sketchLayers(), m_interface.width(), m_interface.height(), window);
+
+    {
+        const domain::StageTimer pickerTimer("picker");
+        m_picker = domain::PlyPicker(m_interface.sketchLayers());
+    }
+
+    const auto toWindow = [this, pixPerMm](const domain::Point& point) {
+        return QPointF{ point.x * pixPerMm + m_origin.x(), m_origin.y() - point.y * pixPerMm };
+    };
+
+    for (const auto& core : m_interface.cores()) {
+        auto& newCore = m_cores.emplace_back();
+        for (const auto& point : core.points()) {
+            newCore << toWindow(point);
+        }
+    }
+
+    for (const auto& highlight : m_interface.diffHighlights(m_diff)) {
+        auto& mark = m_diffMarks.emplace_back(DiffMark{});
+        switch (highlight.kind) {
+        case domain::PlyChangeKind::Added:
+            mark.color = Qt::green;
+            break;
+        case domain::PlyChangeKind::Removed:
+            mark.color = Qt::red;
+            break;
+        default:
+            mark.color = QColor(255, 165, 0);
+            break;
+        }
+        for (const auto& point : highlight.polyline) {
+            mark.polyline << toWindow(point);
+        }
+    }
+
+    if (m_labelsHeight <= 0.) {
+        return;
+    }
+
+    for (const auto& label : m_interface.plyLabels(m_labelsHeight)) {
+        const QPointF bottomLeft = toWindow(label.position);
+        const QSizeF size{ domain::LabelTextWidth(label.text, label.height) * pixPerMm, label.height * pixPerMm };
+
+        m_labels.push_back(Label{
+            .leader = QLineF(toWindow(label.anchor), toWindow(label.leader_end)),
+            .textRect = QRectF(bottomLeft - QPointF(0., size.height()), size),
+            .text = QString::fromStdString(label.text)
+        });
+    }
+}
+
+std::optional<domain::PlyPick> Sketch::pick(QPointF pos, double tolerance) const
+{
+    constexpr double pixPerMm = MainWindow::PixInCm / 10;
+    const domain::Point point{ (pos.x() - m_origin.x()) / pixPerMm, (m_origin.y() - pos.y()) / pixPerMm };
+    return m_picker.pick(point, tolerance / pixPerMm);
+}
+
 void Sketch::setOrigin(QRect window)
 {
+    const domain::StageTimer timer("origin");
     const QPoint newOrigin{
         (window.width() - m_width) / 2,
         window.height() - MainWindow::PanelSize - (window.height() - MainWindow::PanelSize - m_height) / 2
@@ -57,6 +139,16 @@ void Sketch::setOrigin(QRect window)
             point += QPointF(dx, dy);
         }
     }
+    for (auto& core : m_cores) {
+        core.translate(dx, dy);
+    }
+    for (auto& label : m_labels) {
+        label.leader.translate(dx, dy);
+        label.textRect.translate(dx, dy);
+    }
+    for (auto& mark : m_diffMarks) {
+        mark.polyline.translate(dx, dy);
+    }
 
     m_origin = newOrigin;
 }
@@ -72,18 +164,62 @@ void Sketch::draw(QPainter* painter) const
         painter->drawPolyline(layer.polyline);
     }
 
+    if (!m_cores.empty()) {
+        const QBrush oldBrush = painter->brush();
+        painter->setPen(QPen{brush, lineWidth, Qt::SolidLine});
+        painter->setBrush(QBrush(Qt::white, Qt::BDiagPattern));
+        for (const auto& core : m_cores) {
+            painter->drawPolygon(core);
+        }
+        painter->setBrush(oldBrush);
+    }
+
+    // Изменения рисуются поверх линий слоев более толстыми линиями
+    constexpr qreal markWidth = 3.0;
+    constexpr qreal markRadius = 6.0;
+    for (const auto& mark : m_diffMarks) {
+        painter->setPen(QPen{QBrush(mark.color), markWidth, Qt::SolidLine});
+        if (mark.polyline.size() == 1) {
+            painter->drawEllipse(mark.polyline.front(), markRadius, markRadius);
+        }
+        else {
+            painter->drawPolyline(mark.polyline);
+        }
+    }
+
+    if (!m_labels.empty()) {
+        const QFont oldFont = painter->font();
+        QFont font = oldFont;
+        font.setPixelSize(std::max(1, static_cast<int>(m_labels.front().textRect.height())));
+        painter->setFont(font);
+        painter->setPen(QPen{brush, lineWidth, Qt::SolidLine});
+
+        for (const auto& label : m_labels) {
+            painter->drawLine(label.leader);
+            painter->drawText(label.textRect, Qt::AlignCenter, label.text);
+        }
+        painter->setFont(oldFont);
+    }
+
     painter->setPen(oldPen);
 }
 
-void Sketch::update(QRect window, double offset, double length)
+void Sketch::update(QRect window)
 {
-    m_interface.optimizeSketch(offset, length);
     m_layers.clear();
+    m_cores.clear();
+    m_labels.clear();
+    m_diffMarks.clear();
     create(window);
 }
 
 void Sketch::clear(){
     m_layers.clear();
+    m_cores.clear();
+    m_labels.clear();
+    m_diffMarks.clear();
+    m_diff.clear();
+    m_picker = {};
     m_interface.clear();
     m_width = 0;
     m_height = 0;
@@ -94,8 +230,10 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , m_sketch(m_interface)
+    , m_worker(m_interface, &m_timings, &m_trace)
 {
     ui->setupUi(this);
+    m_trace.setThreadName("ui");
     setWindowIcon(QIcon(":/icons/app_icon.png"));
     setMinimumSize(1280, 720);
 
@@ -108,6 +246,29 @@ MainWindow::MainWindow(QWidget *parent)
     installEventFilter(ui->btn_save_file);
     installEventFilter(ui->sb_length);
     installEventFilter(ui->sb_offset);
+
+    // Слой под курсором отслеживается и без нажатых кнопок
+    setMouseTracking(true);
+    centralWidget()->setMouseTracking(true);
+
+    connect(&m_worker, &SketchWorker::resultReady,
+            this, &MainWindow::handleOptimizationResult);
+    connect(&m_worker, &SketchWorker::conversionReady,
+            this, &MainWindow::handleConversionResult);
+    connect(&m_worker, &SketchWorker::conversionProgress,
+            this, &MainWindow::handleConversionProgress);
+    connect(&m_worker, &SketchWorker::revisionReady,
+            this, &MainWindow::handleRevisionResult);
+    connect(&m_worker, &SketchWorker::revisionProgress,
+            this, &MainWindow::handleRevisionProgress);
+
+    m_reloadTimer.setSingleShot(true);
+    m_reloadTimer.setInterval(ReloadDelayMs);
+    connect(&m_reloadTimer, &QTimer::timeout, this, &MainWindow::reloadSourceFile);
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged,
+            this, &MainWindow::handleSourceFileChanged);
+
+    updateHistoryActions();
 }
 
 MainWindow::~MainWindow()
@@ -117,6 +278,7 @@ MainWindow::~MainWindow()
 
 void MainWindow::paintEvent(QPaintEvent* event)
 {
+    const domain::StageTimer timer("paint");
     QPainter painter(this);
     drawBackground(&painter, rect());
 
@@ -125,7 +287,115 @@ void MainWindow::paintEvent(QPaintEvent* event)
         drawAxis(&painter, m_sketch.origin(), rect(),
                  QRect{0, 0, m_sketch.width(), m_sketch.height()});
         m_sketch.draw(&painter);
+        drawSelection(&painter);
+    }
+}
+
+void MainWindow::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton || m_interface.isEmpty()) {
+        return QMainWindow::mousePressEvent(event);
+    }
+    inspectPly(event->pos());
+    const double x = toSketchX(event->pos().x());
+    m_selection.emplace(x, x);
+    m_isSelecting = true;
+    update();
+}
+
+void MainWindow::mouseMoveEvent(QMouseEvent* event)
+{
+    if (!m_isSelecting) {
+        if (!m_interface.isEmpty()) {
+            inspectPly(event->pos());
+        }
+        return QMainWindow::mouseMoveEvent(event);
+    }
+    m_selection->second = toSketchX(event->pos().x());
+    update();
+}
+
+void MainWindow::mouseReleaseEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton || !m_isSelecting) {
+        return QMainWindow::mouseReleaseEvent(event);
+    }
+    m_isSelecting = false;
+
+    // Щелчок без перемещения снимает выделение
+    auto& [first, second] = *m_selection;
+    if (first == second) {
+        m_selection.reset();
     }
+    else if (first > second) {
+        std::swap(first, second);
+    }
+    update();
+}
+
+void MainWindow::inspectPly(QPointF pos)
+{
+    constexpr double pickTolerance = 5.;   // Пиксели
+    const auto picked = m_sketch.pick(pos, pickTolerance);
+    if (!picked.has_value()) {
+        // Сообщения о загрузке и других действиях не стираются
+        if (m_isInspecting) {
+            setStatusMessage("");
+        }
+        return;
+    }
+
+    const ls::NodePosition node = picked->node;
+    const ls::Ply& ply = m_interface.sketchLayers()[node.layerPos].getPly(node.plyPos);
+
+    QString orientation;
+    switch (ply.orientation) {
+    case domain::Orientation::Zero: orientation = tr("0°"); break;
+    case domain::Orientation::Perpendicular: orientation = tr("90°"); break;
+    default: orientation = tr("±45° / other"); break;
+    }
+
+    QString text = tr("Layer %1, ply %2, %3").arg(node.layerPos + 1).arg(node.plyPos + 1).arg(orientation);
+
+    const domain::PlyMeta meta = m_dxHandler.plyMeta().get(ply.meta);
+    if (!meta.handle.empty()) {
+        text += tr("; source: layer \"%1\", handle %2")
+                    .arg(QString::fromStdString(meta.layer), QString::fromStdString(meta.handle));
+    }
+    if (!meta.ply_id.empty()) {
+        text += tr(", ply ID %1").arg(QString::fromStdString(meta.ply_id));
+    }
+    if (!meta.material.empty()) {
+        text += tr(", material %1").arg(QString::fromStdString(meta.material));
+    }
+
+    if (const auto station = m_interface.profileStationAt(node); station.has_value()) {
+        text += tr("; local thickness %1 mm, %2 plies").arg(station->thickness, 0, 'f', 2).arg(station->plies);
+    }
+
+    setStatusMessage(text);
+    m_isInspecting = true;
+}
+
+double MainWindow::toSketchX(int x) const
+{
+    constexpr double pixPerMm = MainWindow::PixInCm / 10;
+    return (x - m_sketch.origin().x()) / pixPerMm;
+}
+
+void MainWindow::drawSelection(QPainter* painter) const
+{
+    if (!m_selection.has_value()) {
+        return;
+    }
+    constexpr double pixPerMm = MainWindow::PixInCm / 10;
+
+    const auto [first, second] = std::minmax(m_selection->first, m_selection->second);
+    const QPoint origin = m_sketch.origin();
+    const QRectF area(origin.x() + first * pixPerMm, origin.y() - m_sketch.height(),
+                      (second - first) * pixPerMm, m_sketch.height());
+
+    painter->fillRect(area, QColor(255, 255, 255, 40));
 }
 
 bool MainWindow::eventFilter(QObject* obj, QEvent* event)
@@ -236,9 +506,17 @@ void MainWindow::on_btn_open_file_clicked()
         else if (reply == QMessageBox::Cancel){
             return;
         }
-        m_sketch.clear();
         m_saveFileSettings.m_fileName = "";
     }
+    // Останавливаем и конвертацию, и оптимизацию, в том числе для еще не готового эскиза
+    m_worker.cancel();
+    m_sketch.clear();
+    m_timings.clear();
+    m_selection.reset();
+    m_reloadTimer.stop();
+    m_isReloading = false;
+    // История прежнего файла очищена, а новый еще не преобразован
+    setEditingEnabled(false);
 
     QFileDialog dialog;
     dialog.setOption(QFileDialog::DontUseNativeDialog);
@@ -250,15 +528,21 @@ void MainWindow::on_btn_open_file_clicked()
 
     const QString fileName = dialog.selectedFiles().first();
 
+    if (!m_watcher.files().isEmpty()) {
+        m_watcher.removePaths(m_watcher.files());
+    }
+    m_sourceFile = fileName;
+    if (ui->action_watch_file->isChecked()) {
+        m_watcher.addPath(m_sourceFile);
+    }
+
     if (m_dxHandler.importFile(fileName.toStdString())) {
-        if (m_interface.fillSketch(m_dxHandler.getRawSketch())) {
-            m_sketch.create(rect());
-            ui->sb_offset->setEnabled(true);
-            ui->sb_length->setEnabled(true);
-            setStatusMessage(tr("File loaded successfully"));
-        } else {
-            setStatusMessage(tr("Invalid file content"));
-        }
+        // Сразу показываем приближенный эскиз, точная конвертация выполняется в фоне
+        auto raw_sketch = m_dxHandler.getRawSketch();
+        m_sketch.createPreview(ls::Interface::makePreview(raw_sketch, m_offset, m_length), rect());
+        update();
+        setStatusMessage(tr("Preview. Converting..."));
+        m_worker.requestConversion(std::move(raw_sketch), m_offset, m_length, conversionBudget());
     } else {
         setStatusMessage(tr("File loading failed"));
     }
@@ -266,8 +550,10 @@ void MainWindow::on_btn_open_file_clicked()
 
 void MainWindow::on_btn_save_file_clicked()
 {
-    if (m_sketch.isEmpty()){
-        setStatusMessage(tr("Nothing to save. Open the file first"));
+    if (m_interface.isEmpty()){
+        // Приближенный эскиз предварительного просмотра не сохраняется
+        setStatusMessage(m_sketch.isEmpty() ? tr("Nothing to save. Open the file first")
+                                            : tr("Wait for the conversion to finish"));
         return;
     }
 
@@ -321,6 +607,19 @@ void MainWindow::on_btn_save_file_clicked()
     }
 
     m_dxHandler.putRawSketch(m_interface.rawSketch());
+    m_dxHandler.putCores(m_interface.cores());
+    if (ui->action_ply_labels->isChecked()) {
+        m_dxHandler.putPlyLabels(m_interface.plyLabels(LabelsHeight));
+    }
+    if (!m_sketch.diff().empty()) {
+        m_dxHandler.putSketchDiff(m_interface.diffHighlights(m_sketch.diff()), m_interface.params().offset);
+    }
+    if (ui->action_thickness_table->isChecked()) {
+        // Таблица справа от эскиза, верхний край на уровне верха эскиза
+        m_dxHandler.putThicknessTable(m_interface.thicknessProfile(),
+                                      { m_interface.width() + 10. * LabelsHeight, m_interface.height() },
+                                      LabelsHeight);
+    }
     const bool success = m_dxHandler.exportFile(
         m_saveFileSettings.m_fileName.toStdString(),
         m_saveFileSettings.m_version,
@@ -333,18 +632,650 @@ void MainWindow::on_btn_save_file_clicked()
 void MainWindow::on_sb_offset_valueChanged(double offset)
 {
     m_offset = offset;
-    m_sketch.update(rect(), m_offset, m_length);
-    update();
+    requestParamsOptimization();
 }
 
 void MainWindow::on_sb_length_valueChanged(double length)
 {
     m_length = length;
-    m_sketch.update(rect(), m_offset, m_length);
+    requestParamsOptimization();
+}
+
+void MainWindow::requestParamsOptimization()
+{
+    // Быстрая серия изменений параметров занимает в истории одно состояние
+    constexpr qint64 mergeIntervalMs = 1000;
+    m_mergeParamsChange = m_paramsChangeTimer.isValid() && m_paramsChangeTimer.elapsed() < mergeIntervalMs;
+    m_paramsChangeTimer.restart();
+
+    m_worker.requestOptimization(m_offset, m_length);
+}
+
+void MainWindow::on_action_auto_fit_triggered()
+{
+    if (m_interface.isEmpty()) {
+        setStatusMessage(tr("Nothing to fit. Open the file first"));
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Auto Fit"));
+
+    const auto createSizeBox = [&dialog](double value) {
+        auto* box = new QDoubleSpinBox(&dialog);
+        box->setRange(10., 10000.);
+        box->setDecimals(1);
+        box->setSuffix(" mm");
+        box->setValue(value);
+        return box;
+    };
+
+    QDoubleSpinBox* widthBox = createSizeBox(m_sheetSize.width());
+    QDoubleSpinBox* heightBox = createSizeBox(m_sheetSize.height());
+
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    auto* layout = new QFormLayout(&dialog);
+    layout->addRow(tr("Sheet width:"), widthBox);
+    layout->addRow(tr("Sheet height:"), heightBox);
+    layout->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    m_sheetSize = QSizeF(widthBox->value(), heightBox->value());
+
+    const ls::ParamsLimits limits{
+        .min_offset = ui->sb_offset->minimum(),
+        .max_offset = ui->sb_offset->maximum(),
+        .min_segment_len = ui->sb_length->minimum(),
+        .max_segment_len = ui->sb_length->maximum()
+    };
+
+    const auto result = m_interface.autoFit(m_sheetSize.width(), m_sheetSize.height(), limits);
+    if (!result.has_value()) {
+        setStatusMessage(tr("The sketch does not fit the sheet"));
+        return;
+    }
+
+    // Округляем вниз до точности полей ввода, сохраняя отношение длины сегмента к расстоянию
+    // между слоями: так округленные параметры не увеличивают габарит эскиза
+    const double offset = std::floor(result->params.offset * 100.) / 100.;
+    const double length = std::floor(result->params.segment_len * offset / result->params.offset * 100.) / 100.;
+
+    // Подбор выполнен без учета локальных параметров, поэтому они сбрасываются
+    m_worker.cancel();
+    m_interface.clearRegions();
+    ui->sb_offset->setValue(offset);
+    ui->sb_length->setValue(length);
+    m_worker.requestOptimization(m_offset, m_length);
+
+    setStatusMessage(tr("Fitted to %1 x %2 mm")
+                         .arg(result->width, 0, 'f', 1)
+                         .arg(result->height, 0, 'f', 1));
+}
+
+void MainWindow::on_action_ply_labels_toggled(bool checked)
+{
+    m_sketch.setLabelsHeight(checked ? LabelsHeight : 0.);
+    if (!m_interface.isEmpty()) {
+        m_sketch.update(rect());
+        update();
+    }
+}
+
+void MainWindow::on_action_export_profile_triggered()
+{
+    const auto& profile = m_interface.thicknessProfile();
+    if (profile.empty()) {
+        setStatusMessage(tr("No thickness profile. Open the file and wait for the conversion"));
+        return;
+    }
+
+    QFileDialog dialog;
+    dialog.setAcceptMode(QFileDialog::AcceptSave);
+    dialog.setOption(QFileDialog::DontUseNativeDialog);
+    dialog.setNameFilter("CSV Files (*.csv)");
+    dialog.setDefaultSuffix("csv");
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    std::ofstream out(dialog.selectedFiles().first().toStdString());
+    domain::WriteProfileCsv(profile, out);
+
+    setStatusMessage(out ? tr("Thickness profile exported") : tr("Export failed"));
+}
+
+void MainWindow::on_action_compare_triggered()
+{
+    if (m_interface.isEmpty()) {
+        setStatusMessage(tr("Nothing to compare. Open the file first"));
+        return;
+    }
+
+    QFileDialog dialog;
+    dialog.setOption(QFileDialog::DontUseNativeDialog);
+    dialog.setNameFilter("DXF/DWG Files (*.dxf *.dwg)");
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    // Прежняя редакция нужна только для сравнения, поэтому импортируется отдельно от открытого файла
+    dx::Handler handler;
+    if (!handler.importFile(dialog.selectedFiles().first().toStdString())) {
+        setStatusMessage(tr("File loading failed"));
+        return;
+    }
+
+    // Редакция конвертируется в рабочем потоке, окно блокируется до результата или отмены
+    m_revisionDialog = new QProgressDialog(tr("Converting the revision..."), tr("Cancel"), 0, 100, this);
+    m_revisionDialog->setWindowModality(Qt::WindowModal);
+    m_revisionDialog->setAutoReset(false);     // Диалог закрывается по результату, а не по 100%
+    m_revisionDialog->setMinimumDuration(0);
+    m_revisionDialog->setValue(0);
+    connect(m_revisionDialog, &QProgressDialog::canceled, this, [this] {
+        m_worker.cancelRevision();
+        closeRevisionDialog();
+        setStatusMessage(tr("Comparison cancelled"));
+    });
+    m_worker.requestRevision(handler.getRawSketch(), conversionBudget());
+}
+
+void MainWindow::handleRevisionResult()
+{
+    const auto before = m_worker.takeRevision();
+    if (!before.has_value() || m_revisionDialog.isNull()) {
+        return;
+    }
+    closeRevisionDialog();
+    // Интерфейс не меняется, пока открыт диалог: открытие файла и изменение параметров заблокированы,
+    // а перезагрузка исходного файла заменяет данные, не очищая интерфейс
+    if (m_interface.isEmpty()) {
+        return;
+    }
+    if (before->data.isEmpty() || before->report.isPartial()) {
+        setStatusMessage(tr("The revision could not be converted"));
+        return;
+    }
+
+    m_sketch.setDiff(m_interface.diffWith(*before));
+    m_sketch.update(rect());
+    update();
+
+    const auto& diff = m_sketch.diff();
+    const auto count = [&diff](domain::PlyChangeKind kind) {
+        return std::count_if(diff.begin(), diff.end(), [kind](const auto& change) { return change.kind == kind; });
+    };
+    setStatusMessage(diff.empty()
+                         ? tr("No changes against the revision")
+                         : tr("Plies added: %1, removed: %2, modified: %3")
+                               .arg(count(domain::PlyChangeKind::Added))
+                               .arg(count(domain::PlyChangeKind::Removed))
+                               .arg(count(domain::PlyChangeKind::Modified)));
+}
+
+void MainWindow::handleRevisionProgress(int percent)
+{
+    // Отложенный сигнал отмененной конвертации не должен открывать диалог заново
+    if (!m_revisionDialog.isNull()) {
+        m_revisionDialog->setValue(percent);
+    }
+}
+
+void MainWindow::closeRevisionDialog()
+{
+    if (m_revisionDialog.isNull()) {
+        return;
+    }
+    // Закрытие диалога испускает canceled, поэтому сначала отключаются его сигналы
+    m_revisionDialog->disconnect(this);
+    m_revisionDialog->hide();
+    m_revisionDialog->deleteLater();
+    m_revisionDialog.clear();
+}
+
+void MainWindow::on_action_clear_comparison_triggered()
+{
+    m_sketch.setDiff({});
+    if (!m_interface.isEmpty()) {
+        m_sketch.update(rect());
+        update();
+    }
+}
+
+void MainWindow::on_action_local_params_triggered()
+{
+    if (m_interface.isEmpty()) {
+        setStatusMessage(tr("Nothing to edit. Open the file first"));
+        return;
+    }
+    if (!m_selection.has_value()) {
+        setStatusMessage(tr("Select a part of the sketch with the mouse first"));
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Local Parameters"));
+
+    const auto createBox = [&dialog](const QDoubleSpinBox* source) {
+        auto* box = new QDoubleSpinBox(&dialog);
+        box->setRange(source->minimum(), source->maximum());
+        box->setSingleStep(source->singleStep());
+        box->setDecimals(source->decimals());
+        box->setValue(source->value());
+        return box;
+    };
+
+    QDoubleSpinBox* offsetBox = createBox(ui->sb_offset);
+    QDoubleSpinBox* lengthBox = createBox(ui->sb_length);
+
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    auto* layout = new QFormLayout(&dialog);
+    layout->addRow(tr("Layer distance:"), offsetBox);
+    layout->addRow(tr("Max segment length:"), lengthBox);
+    layout->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    // Рабочий поток читает параметры участков, поэтому перед изменением он останавливается
+    m_worker.cancel();
+
+    const auto columns = m_interface.columnsInRange(m_selection->first, m_selection->second);
+    const bool isApplied = columns.has_value() && m_interface.setRegionParams(ls::RegionParams{
+        .first_column = columns->first,
+        .last_column = columns->second,
+        .params = { .offset = offsetBox->value(), .segment_len = lengthBox->value() }
+    });
+
+    // Отмененная оптимизация с новыми общими параметрами запрашивается повторно
+    const auto& params = m_interface.params();
+    if (params.offset != m_offset || params.segment_len != m_length) {
+        m_worker.requestOptimization(m_offset, m_length);
+    }
+
+    if (!isApplied) {
+        setStatusMessage(tr("No columns in the selected part"));
+        return;
+    }
+
+    m_interface.commit();
+    updateHistoryActions();
+    m_mergeParamsChange = false;
+    m_selection.reset();
+    m_sketch.update(rect());
+    update();
+    setStatusMessage(tr("Local parameters applied to columns %1-%2")
+                         .arg(columns->first + 1)
+                         .arg(columns->second + 1));
+}
+
+void MainWindow::on_action_reset_local_params_triggered()
+{
+    if (m_interface.regions().empty()) {
+        return;
+    }
+    m_worker.cancel();
+    m_interface.clearRegions();
+    m_mergeParamsChange = false;
+    m_worker.requestOptimization(m_offset, m_length);
+    setStatusMessage(tr("Local parameters reset"));
+}
+
+void MainWindow::on_action_undo_triggered()
+{
+    // Без состояния для отмены выполняемые конвертация и оптимизация не прерываются
+    if (!m_isEditingEnabled || !m_interface.canUndo()) {
+        return;
+    }
+    // Рабочий поток не должен публиковать результат поверх восстановленного состояния
+    m_worker.cancel();
+    if (m_interface.undo()) {
+        showHistoryState();
+    }
+    updateHistoryActions();
+}
+
+void MainWindow::on_action_redo_triggered()
+{
+    if (!m_isEditingEnabled || !m_interface.canRedo()) {
+        return;
+    }
+    m_worker.cancel();
+    if (m_interface.redo()) {
+        showHistoryState();
+    }
+    updateHistoryActions();
+}
+
+void MainWindow::showHistoryState()
+{
+    const auto& params = m_interface.params();
+    m_offset = params.offset;
+    m_length = params.segment_len;
+    m_mergeParamsChange = false;
+
+    // Восстановленное состояние уже оптимизировано, повторная оптимизация не запрашивается
+    const QSignalBlocker offsetBlocker(ui->sb_offset);
+    const QSignalBlocker lengthBlocker(ui->sb_length);
+    ui->sb_offset->setValue(m_offset);
+    ui->sb_length->setValue(m_length);
+
+    m_sketch.update(rect());
     update();
 }
 
+void MainWindow::handleOptimizationResult()
+{
+    auto result = m_worker.takeResult();
+    if (!result.has_value() || m_interface.isEmpty()) {
+        return;
+    }
+    m_interface.setOptimized(std::move(*result));
+    m_interface.commit(m_mergeParamsChange);
+    updateHistoryActions();
+    m_sketch.update(rect());
+    update();
+}
+
+void MainWindow::handleConversionResult()
+{
+    auto result = m_worker.takeConversion();
+    if (!result.has_value()) {
+        return;
+    }
+    const ls::ConversionReport report = result->converted.report;
+    const bool isReload = std::exchange(m_isReloading, false);
+    if (isReload && result->converted.data.isEmpty()) {
+        // Прежний эскиз остается, пока исходный файл не будет исправлен
+        setEditingEnabled(true);
+        setStatusMessage(tr("The changed source file could not be converted"));
+        if (report.isPartial()) {
+            showConversionReport(report);
+        }
+        return;
+    }
+    // Рабочий поток не должен обращаться к интерфейсу, пока в нем меняются данные. Новая
+    // конвертация, запрошенная после изменения файла, продолжается и заменит этот результат
+    m_worker.cancelOptimization();
+    // Исходные и оптимизированные данные публикуются вместе, поэтому подписи, сохранение
+    // и сравнение не видят оптимизированный эскиз прежней структуры
+    if (!result->optimized.has_value()
+        || !m_interface.setConverted(std::move(result->converted), std::move(*result->optimized))) {
+        m_sketch.clear();
+        update();
+        setStatusMessage(tr("Invalid file content"));
+        if (report.isPartial()) {
+            showConversionReport(report);
+        }
+        return;
+    }
+    // Пока идет конвертация поля параметров недоступны, поэтому эскиз оптимизирован с m_offset и m_length
+    m_mergeParamsChange = false;
+    m_interface.commit();
+    if (isReload) {
+        // Позиции слоев изменились, сравнение с прежней редакцией больше не действительно
+        m_sketch.setDiff({});
+    }
+    setEditingEnabled(true);
+    m_sketch.update(rect());
+    update();
+
+    const auto& cleanup = m_interface.cleanupReport();
+    if (report.isPartial()) {
+        setStatusMessage(tr("File loaded partially: %1 of %2 polylines")
+                             .arg(report.total_polylines - report.remaining_polylines)
+                             .arg(report.total_polylines));
+        showConversionReport(report);
+    }
+    else if (isReload) {
+        setStatusMessage(tr("Source file reloaded: reconverted %1 of %2 sections")
+                             .arg(report.sections_count - report.reused_sections)
+                             .arg(report.sections_count));
+    }
+    else if (cleanup.isEmpty()) {
+        setStatusMessage(tr("File loaded successfully"));
+    }
+    else {
+        setStatusMessage(tr("File loaded: welded %1 endpoints, joined %2 polylines, removed %3 duplicates")
+                             .arg(cleanup.welded_endpoints)
+                             .arg(cleanup.joined_polylines)
+                             .arg(cleanup.removed_duplicates));
+    }
+}
+
+void MainWindow::handleConversionProgress(int percent)
+{
+    // Отложенный сигнал уже завершенной конвертации не должен затирать итоговое сообщение
+    if (m_isReloading) {
+        setStatusMessage(tr("Source file changed. Converting... %1%").arg(percent));
+    }
+    else if (m_interface.isEmpty() && !m_sketch.isEmpty()) {
+        setStatusMessage(tr("Preview. Converting... %1%").arg(percent));
+    }
+}
+
+void MainWindow::handleSourceFileChanged(const QString& path)
+{
+    if (path == m_sourceFile) {
+        // Редактор может сохранять файл в несколько приемов, перезагружается последняя редакция
+        m_reloadTimer.start();
+    }
+}
+
+void MainWindow::reloadSourceFile()
+{
+    if (!ui->action_watch_file->isChecked() || m_sourceFile.isEmpty()) {
+        return;
+    }
+    // Файл, сохраненный заменой, удаляется из наблюдения
+    if (!m_watcher.files().contains(m_sourceFile) && QFileInfo::exists(m_sourceFile)) {
+        m_watcher.addPath(m_sourceFile);
+    }
+
+    m_timings.clear();
+    if (!m_dxHandler.importFile(m_sourceFile.toStdString())) {
+        setStatusMessage(tr("The changed source file could not be read"));
+        return;
+    }
+    auto raw_sketch = m_dxHandler.getRawSketch();
+
+    if (m_interface.isEmpty()) {
+        // Эскиз еще не построен - файл загружается заново, как при открытии
+        m_worker.cancel();
+        m_sketch.clear();
+        m_sketch.createPreview(ls::Interface::makePreview(raw_sketch, m_offset, m_length), rect());
+        update();
+        setStatusMessage(tr("Preview. Converting..."));
+        m_worker.requestConversion(std::move(raw_sketch), m_offset, m_length, conversionBudget());
+        return;
+    }
+
+    // Прежний эскиз остается на экране до окончания конвертации. Неизмененные сечения
+    // берутся из кэша рабочего потока, поэтому конвертируются только измененные
+    m_isReloading = true;
+    setEditingEnabled(false);
+    setStatusMessage(tr("Source file changed. Converting..."));
+    m_worker.requestConversion(std::move(raw_sketch), m_offset, m_length, conversionBudget());
+}
+
+void MainWindow::on_action_watch_file_toggled(bool checked)
+{
+    if (checked && !m_sourceFile.isEmpty()) {
+        m_watcher.addPath(m_sourceFile);
+    }
+    else if (!checked && !m_watcher.files().isEmpty()) {
+        m_watcher.removePaths(m_watcher.files());
+        m_reloadTimer.stop();
+    }
+}
+
+void MainWindow::on_action_stage_timings_triggered()
+{
+    const auto stages = m_timings.stages();
+    if (stages.empty()) {
+        setStatusMessage(tr("No stage timings. Open the file first"));
+        return;
+    }
+
+    const auto formatTime = [this](const domain::StageTime& stage) {
+        QString text = tr("%1 s").arg(stage.seconds, 0, 'f', 3);
+        if (stage.calls > 1) {
+            text += tr(" (%1 calls)").arg(stage.calls);
+        }
+        return text;
+    };
+
+    // В строке сообщений - внешние этапы, в подсказке - все этапы, кроме отдельных кругов
+    // выделения слоев: вместо них число кругов и самый долгий круг
+    QStringList summary;
+    QStringList details;
+    size_t rounds = 0;
+    const domain::StageTime* slowestRound = nullptr;
+    for (const auto& stage : stages) {
+        const QString name = QString::fromStdString(stage.stage);
+        if (!name.contains('/')) {
+            summary << name + ' ' + formatTime(stage);
+        }
+        if (name.section('/', -1).startsWith("peel round")) {
+            ++rounds;
+            if (slowestRound == nullptr || stage.seconds > slowestRound->seconds) {
+                slowestRound = &stage;
+            }
+            continue;
+        }
+        if (!name.contains("peel round")) {
+            details << name + ": " + formatTime(stage);
+        }
+    }
+    if (slowestRound != nullptr) {
+        details << tr("peel rounds: %1, slowest: %2, %3")
+                       .arg(rounds)
+                       .arg(QString::fromStdString(slowestRound->stage))
+                       .arg(formatTime(*slowestRound));
+    }
+
+    setStatusMessage(summary.join(", "));
+    ui->lbl_message_text->setToolTip(details.join('\n'));
+}
+
+void MainWindow::on_action_record_trace_toggled(bool checked)
+{
+    if (checked) {
+        m_trace.start();
+        setStatusMessage(tr("Recording the trace. Uncheck Record Trace to save it"));
+        return;
+    }
+
+    m_trace.stop();
+    if (m_trace.isEmpty()) {
+        setStatusMessage(tr("The trace is empty"));
+        return;
+    }
+
+    QFileDialog dialog;
+    dialog.setAcceptMode(QFileDialog::AcceptSave);
+    dialog.setOption(QFileDialog::DontUseNativeDialog);
+    dialog.setNameFilter("Trace Files (*.json)");
+    dialog.setDefaultSuffix("json");
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    std::ofstream out(dialog.selectedFiles().first().toStdString());
+    m_trace.writeChromeTrace(out);
+
+    setStatusMessage(out ? tr("Trace saved. Open it in Perfetto or chrome://tracing") : tr("Export failed"));
+}
+
+void MainWindow::setEditingEnabled(bool enabled)
+{
+    m_isEditingEnabled = enabled;
+    ui->sb_offset->setEnabled(enabled);
+    ui->sb_length->setEnabled(enabled);
+    ui->action_auto_fit->setEnabled(enabled);
+    ui->action_local_params->setEnabled(enabled);
+    ui->action_reset_local_params->setEnabled(enabled);
+    ui->action_compare->setEnabled(enabled);
+    updateHistoryActions();
+}
+
+void MainWindow::updateHistoryActions()
+{
+    ui->action_undo->setEnabled(m_isEditingEnabled && m_interface.canUndo());
+    ui->action_redo->setEnabled(m_isEditingEnabled && m_interface.canRedo());
+}
+
+void MainWindow::showConversionReport(const ls::ConversionReport& report)
+{
+    QString text = (report.status == ls::ConversionStatus::TimedOut)
+                       ? tr("The conversion time limit was exceeded.")
+                       : tr("Some polylines could not be arranged into plies.");
+    text += ' ' + tr("Converted %1 of %2 polylines, the sketch shows only the upper plies.")
+                      .arg(report.total_polylines - report.remaining_polylines)
+                      .arg(report.total_polylines);
+
+    if (!report.expensive.empty()) {
+        text += "\n\n" + tr("Most expensive polylines:");
+        for (const auto& cost : report.expensive) {
+            text += "\n" + tr("(%1, %2) - (%3, %4), %5 points: %6 ms")
+                               .arg(cost.first.x, 0, 'f', 2).arg(cost.first.y, 0, 'f', 2)
+                               .arg(cost.last.x, 0, 'f', 2).arg(cost.last.y, 0, 'f', 2)
+                               .arg(cost.points_count)
+                               .arg(cost.seconds * 1000., 0, 'f', 1);
+        }
+    }
+    QMessageBox::warning(this, tr("Partial Conversion"), text);
+}
+
+std::optional<std::chrono::milliseconds> MainWindow::conversionBudget() const
+{
+    if (m_conversionTimeLimit <= 0.) {
+        return std::nullopt;
+    }
+    return std::chrono::milliseconds(static_cast<long long>(m_conversionTimeLimit * 1000.));
+}
+
+void MainWindow::on_action_time_limit_triggered()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Conversion Time Limit"));
+
+    auto* limitBox = new QDoubleSpinBox(&dialog);
+    limitBox->setRange(0., 3600.);
+    limitBox->setDecimals(0);
+    limitBox->setSuffix(" s");
+    limitBox->setSpecialValueText(tr("No limit"));
+    limitBox->setValue(m_conversionTimeLimit);
+
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    auto* layout = new QFormLayout(&dialog);
+    layout->addRow(tr("Time limit:"), limitBox);
+    layout->addRow(buttons);
+
+    if (dialog.exec() == QDialog::Accepted) {
+        // Применяется со следующей конвертации
+        m_conversionTimeLimit = limitBox->value();
+    }
+}
+
 void MainWindow::setStatusMessage(const QString& message)
 {
+    m_isInspecting = false;
     ui->lbl_message_text->setText(message);
+    ui->lbl_message_text->setToolTip({});
 }
@@ -1,11 +1,22 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
 #include <QMainWindow>
 #include <QPainter>
+#include <QPointer>
+#include <QProgressDialog>
+#include <QTimer>
+
+#include <chrono>
+#include <optional>
 
 #include "dx_handler.h"
 #include "ls_iface.h"
+#include "ls_pick.h"
+#include "sketch_worker.h"
+#include "timing.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -21,13 +32,24 @@ public:
     }
 
     void create(QRect window);
+    // Показывает приближенный эскиз вместо эскиза интерфейса до окончания конвертации.
+    // Слои предварительного просмотра не выбираются курсором
+    void createPreview(const ls::PreviewSketch& preview, QRect window);
     void setOrigin(QRect window);
     QPoint origin() const { return m_origin; }
     int width() const { return m_width; }
     int height() const { return m_height; }
     bool isEmpty() const { return m_layers.empty(); }
+    // Высота текста номеров слоев, мм. Ноль - номера не отображаются
+    void setLabelsHeight(double height) { m_labelsHeight = height; }
+    double labelsHeight() const { return m_labelsHeight; }
+    // Изменения относительно прежней редакции, отображаемые поверх эскиза
+    void setDiff(domain::SketchDiff diff) { m_diff = std::move(diff); }
+    const domain::SketchDiff& diff() const { return m_diff; }
+    // Слой под точкой окна 'pos' не дальше 'tolerance' пикселей, время O(log n) по числу отрезков
+    std::optional<domain::PlyPick> pick(QPointF pos, double tolerance) const;
     void draw(QPainter* painter) const;
-    void update(QRect window, double offset, double length);
+    void update(QRect window);
     void clear();
 
 private:
@@ -36,8 +58,27 @@ private:
         Qt::PenStyle penStyle = Qt::NoPen;
     };
 
+    struct Label {
+        QLineF leader;
+        QRectF textRect;
+        QString text;
+    };
+
+    void createLayers(const std::vector<ls::Layer>& layers, double width, double height, QRect window);
+
     std::vector<Layer> m_layers;
+    std::vector<QPolygonF> m_cores;
+    struct DiffMark {
+        QPolygonF polyline;     // Одна точка - место удаленного слоя
+        QColor color;
+    };
+
+    std::vector<Label> m_labels;
+    std::vector<DiffMark> m_diffMarks;
+    domain::SketchDiff m_diff;
+    domain::PlyPicker m_picker;     // Индекс отрезков слоев в координатах эскиза, мм
     ls::Interface& m_interface;
+    double m_labelsHeight = 0.;
     int m_width = 0;
     int m_height = 0;
     QPoint m_origin;
@@ -57,6 +98,9 @@ public:
 
     constexpr static int PanelSize = 120;
     constexpr static int PixInCm = 30;
+    constexpr static double LabelsHeight = 3.5;    // Высота текста номеров слоев, мм
+    constexpr static double DefaultConversionTimeLimit = 60.;  // Ограничение времени конвертации, с
+    constexpr static int ReloadDelayMs = 500;   // Задержка перезагрузки после последнего изменения файла
 
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
@@ -68,22 +112,80 @@ public:
 protected:
     bool eventFilter(QObject* obj, QEvent* event) override;
     void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
 
 private slots:
     void on_btn_open_file_clicked();
     void on_btn_save_file_clicked();
     void on_sb_offset_valueChanged(double offset);
     void on_sb_length_valueChanged(double length);
+    void on_action_auto_fit_triggered();
+    void on_action_ply_labels_toggled(bool checked);
+    void on_action_export_profile_triggered();
+    void on_action_compare_triggered();
+    void on_action_clear_comparison_triggered();
+    void on_action_time_limit_triggered();
+    void on_action_watch_file_toggled(bool checked);
+    void on_action_stage_timings_triggered();
+    void on_action_record_trace_toggled(bool checked);
+    void on_action_local_params_triggered();
+    void on_action_reset_local_params_triggered();
+    void on_action_undo_triggered();
+    void on_action_redo_triggered();
+    void handleOptimizationResult();
+    void handleConversionResult();
+    void handleConversionProgress(int percent);
+    void handleRevisionResult();
+    void handleRevisionProgress(int percent);
+    void handleSourceFileChanged(const QString& path);
+    void reloadSourceFile();
 
 private:
+    void requestParamsOptimization();
+    void showHistoryState();
+    // Блокирует изменение эскиза, пока выполняется конвертация
+    void setEditingEnabled(bool enabled);
+    // Отмена и повтор доступны, только если в истории есть куда перейти
+    void updateHistoryActions();
+    void showConversionReport(const ls::ConversionReport& report);
+    void closeRevisionDialog();
+    // Ограничение времени конвертации, std::nullopt - без ограничения
+    std::optional<std::chrono::milliseconds> conversionBudget() const;
+    double toSketchX(int x) const;
+    void drawSelection(QPainter* painter) const;
+    // Показывает в строке сообщений данные слоя под курсором
+    void inspectPly(QPointF pos);
+
     Ui::MainWindow *ui;
 
+    // Время этапов последнего открытого файла. Этапы потока интерфейса записываются
+    // на все время существования окна, этапы рабочего потока - через m_worker.
+    // m_trace записывает этапы обоих потоков на шкале времени, пока включена запись
+    domain::TimingReport m_timings;
+    domain::TraceRecorder m_trace;
+    domain::TimingScope m_timingScope{ &m_timings, &m_trace };
     dx::Handler m_dxHandler;
     ls::Interface m_interface;
     Sketch m_sketch;
+    SketchWorker m_worker;
     double m_offset = ls::Interface::DefaultOffset;
     double m_length = ls::Interface::DefaultSegLen;
     SaveFileSettings m_saveFileSettings;
+    QSizeF m_sheetSize{420., 297.};     // Размер листа для автоподбора параметров, мм
+    double m_conversionTimeLimit = DefaultConversionTimeLimit;  // Ноль - без ограничения, с
+    QString m_sourceFile;               // Открытый исходный файл
+    QFileSystemWatcher m_watcher;
+    QTimer m_reloadTimer;               // Объединяет серию изменений файла при сохранении
+    bool m_isReloading = false;         // Выполняется конвертация измененного исходного файла
+    QPointer<QProgressDialog> m_revisionDialog;     // Открыт, пока конвертируется прежняя редакция
+    bool m_isEditingEnabled = false;    // Эскиз преобразован и не конвертируется заново
+    std::optional<std::pair<double, double>> m_selection;   // Выделенный участок эскиза по горизонтали, мм
+    bool m_isSelecting = false;
+    bool m_isInspecting = false;        // В строке сообщений показаны данные слоя под курсором
+    QElapsedTimer m_paramsChangeTimer;
+    bool m_mergeParamsChange = false;   // Результат объединяется в истории с предыдущим изменением параметров
 };
 
 #endif // MAINWINDOW_H
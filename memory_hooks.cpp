@@ -0,0 +1,108 @@
+// Замена глобальных operator new/delete для учета памяти (см. memory_stats.h).
+// Подключается к консольным утилитам при сборке с LAMINATESKETCH_MEMORY_STATS.
+// К приложению Qt не подключается: память, выделенная в нем, может освобождаться
+// в библиотеках Qt их собственным operator delete
+
+#ifdef LAMINATESKETCH_MEMORY_STATS
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "memory_stats.h"
+
+namespace {
+
+// Заголовок перед каждым блоком: размер нужен при освобождении, начало блока malloc -
+// при выравнивании больше стандартного
+struct alignas(std::max_align_t) BlockHeader {
+    void* raw;
+    std::size_t size;
+};
+
+void* TryAllocate(std::size_t size, std::size_t alignment) {
+    const std::size_t padding = (alignment > alignof(BlockHeader)) ? alignment : 0;
+    void* raw = std::malloc(sizeof(BlockHeader) + size + padding);
+    if (raw == nullptr) {
+        return nullptr;
+    }
+    auto address = reinterpret_cast<std::uintptr_t>(raw) + sizeof(BlockHeader);
+    if (padding != 0) {
+        address = (address + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+    }
+    auto* header = reinterpret_cast<BlockHeader*>(address) - 1;
+    header->raw = raw;
+    header->size = size;
+    domain::detail::RecordAllocation(size);
+    return reinterpret_cast<void*>(address);
+}
+
+void* Allocate(std::size_t size, std::size_t alignment) {
+    for (;;) {
+        if (void* ptr = TryAllocate(size, alignment)) {
+            return ptr;
+        }
+        const std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* AllocateNoThrow(std::size_t size, std::size_t alignment) noexcept {
+    try {
+        return Allocate(size, alignment);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void Deallocate(void* ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    const auto* header = static_cast<BlockHeader*>(ptr) - 1;
+    domain::detail::RecordDeallocation(header->size);
+    std::free(header->raw);
+}
+
+constexpr std::size_t DefaultAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+const bool HooksInstalled = (domain::detail::SetMemoryHooksInstalled(), true);
+
+} // namespace
+
+void* operator new(std::size_t size) { return Allocate(size, DefaultAlignment); }
+void* operator new[](std::size_t size) { return Allocate(size, DefaultAlignment); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return AllocateNoThrow(size, DefaultAlignment); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return AllocateNoThrow(size, DefaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return Allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return Allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+
+#endif // LAMINATESKETCH_MEMORY_STATS
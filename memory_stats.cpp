@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include "memory_stats.h"
+
+namespace domain {
+
+namespace {
+
+std::atomic<std::uint64_t> LiveBytes{ 0 };
+std::atomic<std::uint64_t> PeakBytes{ 0 };
+std::atomic<std::uint64_t> Allocations{ 0 };
+std::atomic<std::uint64_t> AllocatedBytes{ 0 };
+std::atomic<bool> HooksInstalled{ false };
+
+template <typename T>
+void UpdateMax(std::atomic<T>& target, T value) {
+    T current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// Пик открытого окна MemoryWindow. Обновляется при каждом выделении, пока ячейка занята
+struct WindowSlot {
+    std::atomic<bool> is_used{ false };
+    std::atomic<std::uint64_t> peak_bytes{ 0 };
+};
+
+std::array<WindowSlot, MaxMemoryWindows> WindowSlots;
+std::atomic<std::size_t> WindowSlotsEnd{ 0 };      // Граница когда-либо занятых ячеек
+
+} // namespace
+
+void MemoryUsage::add(const MemoryUsage& other) {
+    allocations += other.allocations;
+    allocated_bytes += other.allocated_bytes;
+    retained_bytes += other.retained_bytes;
+    live_bytes = other.live_bytes;
+    peak_bytes = std::max(peak_bytes, other.peak_bytes);
+}
+
+bool MemoryStatsAvailable() {
+    return MemoryStatsEnabled && HooksInstalled.load(std::memory_order_relaxed);
+}
+
+MemoryStats ReadMemoryStats() {
+    return {
+        .live_bytes = LiveBytes.load(std::memory_order_relaxed),
+        .peak_bytes = PeakBytes.load(std::memory_order_relaxed),
+        .allocations = Allocations.load(std::memory_order_relaxed),
+        .allocated_bytes = AllocatedBytes.load(std::memory_order_relaxed)
+    };
+}
+
+MemoryWindow::MemoryWindow() {
+    if constexpr (MemoryStatsEnabled) {
+        for (std::size_t i = 0; i < MaxMemoryWindows; ++i) {
+            bool is_used = false;
+            if (WindowSlots[i].is_used.compare_exchange_strong(is_used, true, std::memory_order_relaxed)) {
+                slot_ = i;
+                break;
+            }
+        }
+        start_ = ReadMemoryStats();
+        if (slot_ != NoSlot) {
+            // Выделения до этой точки могли уже обновить ячейку - пик окна отсчитывается от начала
+            WindowSlots[slot_].peak_bytes.store(start_.live_bytes, std::memory_order_relaxed);
+            UpdateMax(WindowSlotsEnd, slot_ + 1);
+        }
+    }
+}
+
+MemoryWindow::~MemoryWindow() {
+    if (slot_ != NoSlot) {
+        WindowSlots[slot_].is_used.store(false, std::memory_order_relaxed);
+    }
+}
+
+MemoryUsage MemoryWindow::finish() {
+    if constexpr (MemoryStatsEnabled) {
+        const MemoryStats end = ReadMemoryStats();
+        std::uint64_t peak = std::max(start_.live_bytes, end.live_bytes);
+        if (slot_ != NoSlot) {
+            peak = std::max(peak, WindowSlots[slot_].peak_bytes.load(std::memory_order_relaxed));
+            WindowSlots[slot_].is_used.store(false, std::memory_order_relaxed);
+            slot_ = NoSlot;
+        }
+        return {
+            .allocations = end.allocations - start_.allocations,
+            .allocated_bytes = end.allocated_bytes - start_.allocated_bytes,
+            .retained_bytes = static_cast<std::int64_t>(end.live_bytes) - static_cast<std::int64_t>(start_.live_bytes),
+            .live_bytes = end.live_bytes,
+            .peak_bytes = peak
+        };
+    }
+    else {
+        return {};
+    }
+}
+
+namespace detail {
+
+void RecordAllocation(std::size_t size) {
+    Allocations.fetch_add(1, std::memory_order_relaxed);
+    AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    const std::uint64_t live = LiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    UpdateMax(PeakBytes, live);
+    const std::size_t end = WindowSlotsEnd.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < end; ++i) {
+        if (WindowSlots[i].is_used.load(std::memory_order_relaxed)) {
+            UpdateMax(WindowSlots[i].peak_bytes, live);
+        }
+    }
+}
+
+void RecordDeallocation(std::size_t size) {
+    LiveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void SetMemoryHooksInstalled() {
+    HooksInstalled.store(true, std::memory_order_relaxed);
+}
+
+} // namespace detail
+
+} // namespace domain
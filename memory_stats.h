@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace domain {
+
+// Учет памяти включается при сборке опцией LAMINATESKETCH_MEMORY_STATS. Выделения считает
+// замена глобальных operator new/delete из memory_hooks.cpp, которая подключается только
+// к консольным утилитам. Без опции MemoryWindow ничего не замеряет
+#ifdef LAMINATESKETCH_MEMORY_STATS
+constexpr bool MemoryStatsEnabled = true;
+#else
+constexpr bool MemoryStatsEnabled = false;
+#endif
+
+// Состояние памяти процесса, выделенной через operator new
+struct MemoryStats {
+    std::uint64_t live_bytes = 0;       // Занято сейчас
+    std::uint64_t peak_bytes = 0;       // Наибольшее занятое с начала работы
+    std::uint64_t allocations = 0;      // Число выделений с начала работы
+    std::uint64_t allocated_bytes = 0;  // Суммарный объем выделений с начала работы
+};
+
+// Расход памяти этапа. Счетчики общие для процесса: при параллельной работе в этап
+// попадают и выделения других потоков
+struct MemoryUsage {
+    std::uint64_t allocations = 0;
+    std::uint64_t allocated_bytes = 0;
+    std::int64_t retained_bytes = 0;    // Прирост занятой памяти от начала до конца этапа
+    std::uint64_t live_bytes = 0;       // Занято в конце этапа
+    std::uint64_t peak_bytes = 0;       // Наибольшее занятое во время этапа
+
+    // Добавляет очередной вызов этапа
+    void add(const MemoryUsage& other);
+};
+
+// true, если сборка с учетом памяти и к программе подключена замена operator new
+bool MemoryStatsAvailable();
+MemoryStats ReadMemoryStats();
+
+// Замеряет расход памяти от создания до вызова finish(). Окна могут быть вложенными
+// и пересекаться в разных потоках: пик каждого окна ведет замена operator new в своей ячейке.
+// Ячеек MaxMemoryWindows; если все заняты, пиком окна считается больший из объемов
+// в начале и в конце
+class MemoryWindow {
+public:
+    MemoryWindow();
+    ~MemoryWindow();
+    MemoryUsage finish();
+
+    MemoryWindow(const MemoryWindow&) = delete;
+    MemoryWindow& operator=(const MemoryWindow&) = delete;
+
+private:
+    static constexpr std::size_t NoSlot = static_cast<std::size_t>(-1);
+
+    MemoryStats start_;
+    std::size_t slot_ = NoSlot;         // Ячейка пика окна
+};
+
+// Наибольшее число одновременно открытых окон с собственным пиком
+constexpr std::size_t MaxMemoryWindows = 256;
+
+namespace detail {
+
+// Вызываются заменой operator new/delete
+void RecordAllocation(std::size_t size);
+void RecordDeallocation(std::size_t size);
+void SetMemoryHooksInstalled();
+
+} // namespace detail
+
+} // namespace domain
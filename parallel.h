@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "counters.h"
+#include "timing.h"
+
+namespace domain {
+
+// Количество рабочих потоков по умолчанию
+inline size_t DefaultThreadsCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Выполняет func(index) для всех index из [0, count) в пуле потоков.
+// Задачи раздаются по одной через атомарный счетчик, поэтому неравные по
+// стоимости задачи распределяются равномерно. Первое исключение пробрасывается вызывающему
+template <typename Func>
+void ParallelFor(size_t count, Func&& func, size_t threads_count = DefaultThreadsCount()) {
+    threads_count = std::min(threads_count, count);
+
+    if (threads_count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next_index = 0;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    // Этапы задач записываются в отчет вызывающего потока как вложенные в его текущий этап
+    const TimingContext timing = CurrentTimingContext();
+    CounterSet* const counters = CurrentCounterSet();
+
+    auto worker = [&] {
+        TimingScope timing_scope(timing);
+        CounterScope counter_scope(counters);
+        for (size_t i = next_index++; i < count; i = next_index++) {
+            try {
+                func(i);
+            }
+            catch (...) {
+                std::lock_guard lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::jthread> threads;
+    threads.reserve(threads_count - 1);
+    for (size_t i = 1; i < threads_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();   // Текущий поток тоже участвует в работе
+    threads.clear();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace domain
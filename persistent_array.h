@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace domain {
+
+// Неизменяемый массив, разбитый на блоки с общим владением.
+// Новая версия массива разделяет с предыдущей все блоки, значения в которых не изменились,
+// поэтому хранение версии стоит памяти пропорционально изменениям (плюс таблица блоков)
+template <typename T, size_t ChunkSize = 256>
+class PersistentArray {
+public:
+    using Chunk = std::vector<T>;
+
+    size_t size() const noexcept { return size_; }
+    bool isEmpty() const noexcept { return size_ == 0; }
+
+    // Строит версию массива из 'size' значений, которые по порядку возвращает 'next()'.
+    // Блоки, совпадающие по 'equal' с блоками 'base', не копируются, а разделяются с ним
+    template <typename Next, typename Equal>
+    static PersistentArray build(size_t size, Next&& next, const PersistentArray& base, Equal&& equal) {
+        PersistentArray result;
+        result.size_ = size;
+        result.chunks_.reserve((size + ChunkSize - 1) / ChunkSize);
+
+        Chunk buffer;
+        buffer.reserve(std::min(size, ChunkSize));
+
+        for (size_t i = 0; i < size; ++i) {
+            buffer.push_back(next());
+            if (buffer.size() < ChunkSize && i + 1 < size) {
+                continue;
+            }
+
+            const size_t index = result.chunks_.size();
+            if (index < base.chunks_.size()
+                && std::equal(buffer.begin(), buffer.end(),
+                              base.chunks_[index]->begin(), base.chunks_[index]->end(), equal)) {
+                result.chunks_.push_back(base.chunks_[index]);
+                buffer.clear();
+            }
+            else {
+                result.chunks_.push_back(std::make_shared<const Chunk>(std::move(buffer)));
+                buffer = Chunk{};
+                buffer.reserve(std::min(size - i - 1, ChunkSize));
+            }
+        }
+        return result;
+    }
+
+    // Вызывает apply(index, value) для элементов блоков, не разделяемых с 'from'.
+    // Время пропорционально числу измененных блоков
+    template <typename Apply>
+    void forEachChanged(const PersistentArray& from, Apply&& apply) const {
+        for (size_t index = 0; index < chunks_.size(); ++index) {
+            if (index < from.chunks_.size() && chunks_[index] == from.chunks_[index]) {
+                continue;
+            }
+            const Chunk& chunk = *chunks_[index];
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                apply(index * ChunkSize + i, chunk[i]);
+            }
+        }
+    }
+
+    // Признак того, что все блоки разделяются с 'other'
+    bool isSharedWith(const PersistentArray& other) const noexcept {
+        return size_ == other.size_ && chunks_ == other.chunks_;
+    }
+
+private:
+    std::vector<std::shared_ptr<const Chunk>> chunks_;
+    size_t size_ = 0;
+};
+
+} // namespace domain
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <utility>
+
+namespace domain {
+
+// Ход выполнения долгой операции: запрос остановки, ограничение времени и доля выполненной работы.
+// Копии разделяют общий счетчик работы и могут использоваться из разных потоков
+class Progress {
+public:
+    using Clock = std::chrono::steady_clock;
+    // Вызывается из рабочего потока при изменении процента выполнения
+    using Callback = std::function<void(int percent)>;
+
+    Progress() = default;
+
+    // 'budget' - ограничение времени от момента создания, std::nullopt - без ограничения
+    explicit Progress(std::stop_token stop, std::optional<Clock::duration> budget = std::nullopt,
+                      Callback on_progress = {})
+        : stop_(std::move(stop))
+        , state_(std::make_shared<State>())
+    {
+        if (budget.has_value()) {
+            deadline_ = Clock::now() + *budget;
+        }
+        state_->on_progress = std::move(on_progress);
+    }
+
+    bool isCancelled() const noexcept { return stop_.stop_requested(); }
+    bool isExpired() const noexcept { return deadline_.has_value() && Clock::now() >= *deadline_; }
+    bool shouldStop() const noexcept { return isCancelled() || isExpired(); }
+
+    // Добавляет к общему объему работы 'units' единиц
+    void addWork(size_t units) const {
+        if (state_) {
+            state_->total += units;
+        }
+    }
+
+    // Отмечает выполнение 'units' единиц работы
+    void advance(size_t units) const {
+        if (!state_ || !state_->on_progress) {
+            return;
+        }
+        const size_t done = state_->done += units;
+        const size_t total = state_->total;
+        const int percent = (total == 0) ? 100 : static_cast<int>(std::min<size_t>(done, total) * 100 / total);
+
+        // Обработчик вызывается один раз на каждый новый процент
+        int last = state_->last_percent;
+        while (percent > last) {
+            if (state_->last_percent.compare_exchange_weak(last, percent)) {
+                state_->on_progress(percent);
+                break;
+            }
+        }
+    }
+
+private:
+    struct State {
+        std::atomic<size_t> total = 0;
+        std::atomic<size_t> done = 0;
+        std::atomic<int> last_percent = -1;
+        Callback on_progress;
+    };
+
+    std::stop_token stop_;
+    std::optional<Clock::time_point> deadline_;
+    std::shared_ptr<State> state_;
+};
+
+} // namespace domain
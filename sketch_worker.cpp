@@ -0,0 +1,239 @@
+#include "sketch_worker.h"
+
+SketchWorker::SketchWorker(const ls::Interface& interface, domain::TimingReport* timings,
+                           domain::TraceRecorder* trace, QObject* parent)
+    : QObject(parent)
+    , m_interface(interface)
+    , m_timings(timings)
+    , m_trace(trace)
+    , m_thread([this](std::stop_token stop) { run(stop); })
+{
+}
+
+SketchWorker::~SketchWorker()
+{
+    m_thread.request_stop();
+    {
+        std::lock_guard lock(m_mutex);
+        m_current.request_stop();
+        m_currentRevision.request_stop();
+    }
+    // Поток будет присоединен в деструкторе std::jthread
+}
+
+void SketchWorker::requestOptimization(double offset, double length)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_pending = Request{ .offset = offset, .length = length, .generation = m_generation };
+        m_current.request_stop();   // Устаревший запрос больше не нужен
+    }
+    m_condition.notify_all();
+}
+
+void SketchWorker::requestConversion(domain::RawData&& raw_sketch, double offset, double length,
+                                     std::optional<std::chrono::milliseconds> budget)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        // Оптимизация прежних данных интерфейса после конвертации не нужна: интерфейс получит
+        // новые данные, а ее результат будет указывать на прежнюю структуру эскиза
+        ++m_generation;
+        m_pending.reset();
+        m_result.reset();
+        m_pendingConversion = std::move(raw_sketch);
+        m_pendingBudget = budget;
+        m_pendingParams = { .offset = offset, .segment_len = length };
+        m_current.request_stop();
+    }
+    m_condition.notify_all();
+}
+
+void SketchWorker::requestRevision(domain::RawData&& raw_sketch, std::optional<std::chrono::milliseconds> budget)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_pendingRevision = std::move(raw_sketch);
+        m_revisionBudget = budget;
+        m_revision.reset();
+        m_currentRevision.request_stop();
+    }
+    m_condition.notify_all();
+}
+
+void SketchWorker::cancelRevision()
+{
+    std::unique_lock lock(m_mutex);
+    m_pendingRevision.reset();
+    m_currentRevision.request_stop();
+    m_condition.wait(lock, [this] { return !m_isRevising; });
+    m_revision.reset();
+}
+
+void SketchWorker::cancel()
+{
+    std::unique_lock lock(m_mutex);
+    ++m_generation;
+    m_pending.reset();
+    m_pendingConversion.reset();
+    m_pendingRevision.reset();
+    m_current.request_stop();
+    m_currentRevision.request_stop();
+    m_condition.wait(lock, [this] { return !m_busy; });
+    m_result.reset();
+    m_conversion.reset();
+    m_revision.reset();
+}
+
+void SketchWorker::cancelOptimization()
+{
+    std::unique_lock lock(m_mutex);
+    ++m_generation;
+    m_pending.reset();
+    if (m_isOptimizing) {
+        m_current.request_stop();
+    }
+    m_condition.wait(lock, [this] { return !m_isOptimizing; });
+    m_result.reset();
+}
+
+std::optional<ls::OptimizedSketch> SketchWorker::takeResult()
+{
+    std::lock_guard lock(m_mutex);
+    if (m_resultGeneration != m_generation) {
+        m_result.reset();
+    }
+    return std::exchange(m_result, std::nullopt);
+}
+
+std::optional<SketchWorker::Conversion> SketchWorker::takeConversion()
+{
+    std::lock_guard lock(m_mutex);
+    return std::exchange(m_conversion, std::nullopt);
+}
+
+std::optional<ls::ConvertedSketch> SketchWorker::takeRevision()
+{
+    std::lock_guard lock(m_mutex);
+    return std::exchange(m_revision, std::nullopt);
+}
+
+void SketchWorker::run(std::stop_token stop)
+{
+    const domain::TimingScope timing(m_timings, m_trace);
+    if (m_trace != nullptr) {
+        m_trace->setThreadName("sketch worker");
+    }
+
+    while (true) {
+        std::optional<Request> request;
+        std::optional<domain::RawData> raw_sketch;
+        std::optional<domain::RawData> revision;
+        std::optional<std::chrono::milliseconds> budget;
+        ls::OptimizationParams params;
+        std::stop_source current;
+        {
+            std::unique_lock lock(m_mutex);
+            if (!m_condition.wait(lock, stop, [this] {
+                    return m_pending.has_value() || m_pendingConversion.has_value() || m_pendingRevision.has_value();
+                })) {
+                return;     // Остановка потока
+            }
+            if (m_pendingConversion.has_value()) {
+                raw_sketch = std::exchange(m_pendingConversion, std::nullopt);
+                budget = m_pendingBudget;
+                params = m_pendingParams;
+            }
+            else if (m_pending.has_value()) {
+                request = std::exchange(m_pending, std::nullopt);
+            }
+            else {
+                revision = std::exchange(m_pendingRevision, std::nullopt);
+                budget = m_revisionBudget;
+            }
+            current = std::stop_source{};
+            if (revision.has_value()) {
+                m_currentRevision = current;
+            }
+            else {
+                m_current = current;
+            }
+            m_busy = true;
+            m_isOptimizing = request.has_value();
+            m_isRevising = revision.has_value();
+        }
+
+        if (revision.has_value()) {
+            const domain::Progress progress(current.get_token(), budget,
+                                            [this](int percent) { emit revisionProgress(percent); });
+            auto converted = ls::Interface::convertSketch(std::move(*revision), progress);
+
+            bool isReady = false;
+            {
+                std::lock_guard lock(m_mutex);
+                m_busy = false;
+                m_isRevising = false;
+                if (converted.has_value() && !current.stop_requested()) {
+                    m_revision = std::move(converted);
+                    isReady = true;
+                }
+            }
+            m_condition.notify_all();
+
+            if (isReady) {
+                emit revisionReady();
+            }
+            continue;
+        }
+
+        if (raw_sketch.has_value()) {
+            const domain::Progress progress(current.get_token(), budget,
+                                            [this](int percent) { emit conversionProgress(percent); });
+            auto converted = ls::Interface::convertSketch(std::move(*raw_sketch), progress, &m_sectionCache);
+
+            // Оптимизированный эскиз строится до публикации, чтобы интерфейс получил
+            // исходные и оптимизированные данные одной структуры одновременно
+            std::optional<ls::OptimizedSketch> optimized;
+            if (converted.has_value() && !converted->data.isEmpty()) {
+                optimized = ls::Interface::optimizeConverted(*converted, params.offset, params.segment_len,
+                                                             domain::Progress(current.get_token()));
+            }
+
+            bool isReady = false;
+            {
+                std::lock_guard lock(m_mutex);
+                m_busy = false;
+                if (converted.has_value() && !current.stop_requested()) {
+                    m_conversion = Conversion{ .converted = std::move(*converted), .optimized = std::move(optimized) };
+                    isReady = true;
+                }
+            }
+            m_condition.notify_all();
+
+            if (isReady) {
+                emit conversionReady();
+            }
+            continue;
+        }
+
+        auto result = m_interface.makeOptimized(request->offset, request->length,
+                                                domain::Progress(current.get_token()));
+
+        bool isReady = false;
+        {
+            std::lock_guard lock(m_mutex);
+            m_busy = false;
+            m_isOptimizing = false;
+            if (result.has_value() && !current.stop_requested() && request->generation == m_generation) {
+                m_result = std::move(result);
+                m_resultGeneration = request->generation;
+                isReady = true;
+            }
+        }
+        m_condition.notify_all();
+
+        if (isReady) {
+            emit resultReady();
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef SKETCH_WORKER_H
+#define SKETCH_WORKER_H
+
+#include <QObject>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+
+#include "ls_iface.h"
+#include "timing.h"
+
+// Выполняет конвертацию и оптимизацию эскиза в рабочем потоке.
+// Частые запросы объединяются: выполняется только последний,
+// а выполняемый устаревший запрос кооперативно отменяется.
+// Ожидающая конвертация выполняется раньше ожидающей оптимизации,
+// а конвертация прежней редакции для сравнения - после них.
+class SketchWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Время этапов конвертации и оптимизации записывается в 'timings', если он задан,
+    // и в 'trace', пока в нем включена запись
+    explicit SketchWorker(const ls::Interface& interface, domain::TimingReport* timings = nullptr,
+                          domain::TraceRecorder* trace = nullptr, QObject* parent = nullptr);
+    ~SketchWorker();
+
+    // Ставит запрос в очередь вместо ожидающего и отменяет выполняемый
+    void requestOptimization(double offset, double length);
+
+    // Преобразованный эскиз и эскиз, оптимизированный по нему. Публикуются в интерфейс
+    // вместе, см. ls::Interface::setConverted
+    struct Conversion {
+        ls::ConvertedSketch converted;
+        std::optional<ls::OptimizedSketch> optimized;  // Пусто, если эскиз не удалось построить
+    };
+
+    // Ставит в очередь точную конвертацию исходного эскиза с ограничением времени 'budget'
+    // и его оптимизацию с параметрами 'offset' и 'length' (оптимизация времени не ограничена).
+    // Ожидающая оптимизация и ее неполученный результат отбрасываются
+    // (std::nullopt - без ограничения). Результат не зависит от интерфейса и передается в него
+    // через takeConversion; по истечении времени результат частичный, см. ls::ConversionReport.
+    // Сечения, не изменившиеся после предыдущей конвертации, берутся из кэша рабочего потока
+    void requestConversion(domain::RawData&& raw_sketch, double offset, double length,
+                           std::optional<std::chrono::milliseconds> budget = std::nullopt);
+
+    // Ставит в очередь конвертацию прежней редакции эскиза для сравнения с ограничением
+    // времени 'budget', заменяя ожидающую и отменяя выполняемую конвертацию редакции.
+    // Редакция не использует интерфейс и кэш сечений и выполняется после ожидающих конвертации
+    // и оптимизации; другие запросы ее не прерывают. Результат передается через takeRevision
+    void requestRevision(domain::RawData&& raw_sketch,
+                         std::optional<std::chrono::milliseconds> budget = std::nullopt);
+
+    // Отменяет только конвертацию прежней редакции и дожидается ее остановки
+    void cancelRevision();
+
+    // Отменяет все запросы, включая конвертацию прежней редакции, и дожидается остановки вычислений.
+    // Необходимо вызывать перед изменением исходных данных интерфейса
+    void cancel();
+
+    // Отменяет только оптимизацию и дожидается ее остановки; ожидающая и выполняемая
+    // конвертация продолжаются. Достаточно перед передачей в интерфейс результата конвертации:
+    // конвертация к интерфейсу не обращается
+    void cancelOptimization();
+
+    // Забирает готовый результат (если он есть). Результат оптимизации, запрошенной
+    // до последней отмены или конвертации, построен по прежним данным и отбрасывается
+    std::optional<ls::OptimizedSketch> takeResult();
+
+    // Забирает готовый результат конвертации (если он есть).
+    // Пустые данные в результате означают, что эскиз не удалось построить
+    std::optional<Conversion> takeConversion();
+
+    // Забирает готовый результат конвертации прежней редакции (если он есть)
+    std::optional<ls::ConvertedSketch> takeRevision();
+
+signals:
+    // Испускается из рабочего потока, когда результат готов к публикации
+    void resultReady();
+
+    // Испускается из рабочего потока, когда готов результат конвертации
+    void conversionReady();
+
+    // Испускается из рабочего потока при изменении процента выполнения конвертации
+    void conversionProgress(int percent);
+
+    // Испускается из рабочего потока, когда готов результат конвертации прежней редакции
+    void revisionReady();
+
+    // Испускается из рабочего потока при изменении процента выполнения конвертации прежней редакции
+    void revisionProgress(int percent);
+
+private:
+    struct Request {
+        double offset = 0.;
+        double length = 0.;
+        size_t generation = 0;      // Поколение данных интерфейса на момент запроса
+    };
+
+    void run(std::stop_token stop);
+
+    const ls::Interface& m_interface;
+    domain::TimingReport* m_timings;
+    domain::TraceRecorder* m_trace;
+
+    std::mutex m_mutex;
+    std::condition_variable_any m_condition;
+    std::optional<Request> m_pending;
+    std::optional<domain::RawData> m_pendingConversion;
+    std::optional<std::chrono::milliseconds> m_pendingBudget;
+    ls::OptimizationParams m_pendingParams;     // Параметры оптимизации ожидающей конвертации
+    std::optional<ls::OptimizedSketch> m_result;
+    std::optional<Conversion> m_conversion;
+    std::optional<domain::RawData> m_pendingRevision;
+    std::optional<std::chrono::milliseconds> m_revisionBudget;
+    std::optional<ls::ConvertedSketch> m_revision;
+    ls::SectionCache m_sectionCache;    // Используется только рабочим потоком
+    std::stop_source m_current;
+    std::stop_source m_currentRevision; // Останавливается только отменой редакции или всех запросов
+    bool m_busy = false;
+    bool m_isOptimizing = false;        // Выполняется оптимизация, обращающаяся к интерфейсу
+    bool m_isRevising = false;          // Выполняется конвертация прежней редакции
+    // Поколение данных интерфейса: увеличивается при отмене и запросе конвертации
+    size_t m_generation = 0;
+    size_t m_resultGeneration = 0;
+
+    std::jthread m_thread;  // Объявлен последним: поток запускается после инициализации остальных членов
+};
+
+#endif // SKETCH_WORKER_H
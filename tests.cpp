@@ -0,0 +1,508 @@
+// Проверки ядра на небольших эскизах, построенных в коде: очистка "сырого" эскиза, преобразование
+// с ограничением времени, независимые сечения, история изменений, соединение узлов, данные исходных
+// слоев, заполнители, профиль толщины, подбор параметров, синтетические эскизы, сравнение редакций
+// и публикация преобразованного эскиза
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ls_cleanup.h"
+#include "ls_cores.h"
+#include "ls_iface.h"
+#include "ls_meta.h"
+#include "ls_synth.h"
+
+namespace {
+
+using namespace domain;
+
+struct Test {
+    std::string name;
+    std::function<void()> run;
+};
+
+size_t failures_count = 0;
+
+void Check(bool condition, std::string_view expression, int line) {
+    if (!condition) {
+        std::cerr << "  line " << line << ": " << expression << std::endl;
+        ++failures_count;
+    }
+}
+
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+RawPolyline MakePolyline(Polyline points) {
+    return RawPolyline{ .polyline = std::move(points) };
+}
+
+// Пакет горизонтальных слоев с шагом 0.25 мм от 'bottom' до 'top' включительно. Слои начинаются
+// в 'left', каждый следующий короче на 5 мм, поэтому одинаково смещенные слои не совпадают с соседями
+void AddPlies(RawData& raw, int bottom, int top, double left, double right) {
+    for (int i = bottom; i <= top; ++i) {
+        Polyline points;
+        for (double x = left; x <= right - 5. * (i - bottom); x += 5.) {
+            points.push_back({ x, 0.25 * i });
+        }
+        raw.push_back(MakePolyline(std::move(points)));
+    }
+}
+
+// ---- Очистка "сырого" эскиза ----
+
+// Слой и обратный слой, соприкасающиеся обоими концами, остаются двумя слоями и не становятся заполнителем
+void TestTouchingPliesStaySeparate() {
+    RawData raw{
+        MakePolyline({ { 0., 0. }, { 5., -1. }, { 10., 0. } }),
+        MakePolyline({ { 10., 0.005 }, { 5., 1. }, { 0., 0.005 } })
+    };
+    const auto report = CleanupRawSketch(raw);
+
+    CHECK(report.joined_polylines == 0);
+    CHECK(raw.size() == 2);
+    CHECK(ExtractCores(raw).empty());
+    CHECK(raw.size() == 2);
+}
+
+// Цепочка концов с шагом 0.9 допуска не сводится в одну точку: каждый конец смещается не больше допуска
+void TestWeldClusterWithinTolerance() {
+    const double step = 0.9 * DefaultWeldTolerance;
+    const Polyline ends{ { 0., 0. }, { step, 0. }, { 2. * step, 0. }, { 3. * step, 0. } };
+
+    RawData raw;
+    for (size_t i = 0; i < ends.size(); ++i) {
+        // Ломаные расходятся от концов в разные стороны. Соседние ломаные разного направления
+        // укладки, поэтому сваренные концы не объединяют их в одну ломаную
+        const double direction = (i % 2 == 0) ? 1. : -1.;
+        auto& ply = raw.emplace_back(MakePolyline({ ends[i], { ends[i].x + 1., direction * (1. + static_cast<double>(i)) } }));
+        ply.orientation = (i % 2 == 0) ? Orientation::Zero : Orientation::Perpendicular;
+    }
+    const auto report = CleanupRawSketch(raw);
+
+    CHECK(report.welded_endpoints > 0);
+    CHECK(raw.size() == ends.size());
+    size_t index = 0;
+    for (const auto& ply : raw) {
+        CHECK(DistanceBetweenPoints(ply.polyline.front(), ends[index]) <= DefaultWeldTolerance);
+        ++index;
+    }
+}
+
+// ---- Преобразование с ограничением времени ----
+
+// Итог преобразования считает ломаные всех сечений: полное преобразование не оставляет ломаных,
+// истекшее время оставляет все ломаные и дает частичный результат, а запрос остановки - пустой
+void TestPartialConversionReport() {
+    RawData raw;
+    AddPlies(raw, 0, 4, 0., 40.);
+    AddPlies(raw, 0, 3, 100., 140.);
+    const size_t polylines_count = raw.size();
+
+    const auto completed = ls::Interface::convertSketch(RawData(raw));
+    CHECK(completed.has_value());
+    if (completed.has_value()) {
+        CHECK(completed->report.status == ls::ConversionStatus::Completed);
+        CHECK(completed->report.total_polylines == polylines_count);
+        CHECK(completed->report.remaining_polylines == 0);
+        CHECK(completed->report.sections_count == 2);
+        CHECK(completed->report.expensive.size() <= ls::ConversionReport::MaxExpensive);
+    }
+
+    const auto expired = ls::Interface::convertSketch(
+        RawData(raw), Progress(std::stop_token{}, std::chrono::steady_clock::duration::zero()));
+    CHECK(expired.has_value());
+    if (expired.has_value()) {
+        CHECK(expired->report.isPartial() && expired->report.status == ls::ConversionStatus::TimedOut);
+        CHECK(expired->report.total_polylines == polylines_count);
+        CHECK(expired->report.remaining_polylines == polylines_count);
+        CHECK(expired->data.isEmpty());
+    }
+
+    std::stop_source stop;
+    stop.request_stop();
+    CHECK(!ls::Interface::convertSketch(RawData(raw), Progress(stop.get_token())).has_value());
+}
+
+// ---- Независимые сечения ----
+
+// Сечения размещаются слева направо и помнят свое положение в файле. При повторном преобразовании
+// неизмененные сечения, в том числе сдвинутые целиком, берутся из кэша
+void TestSectionsMergedAndReused() {
+    RawData first;
+    AddPlies(first, 0, 4, 0., 40.);
+    RawData second;
+    AddPlies(second, 0, 3, 100., 140.);
+    auto make_raw = [&](double second_shift) {
+        RawData result = first;
+        for (auto ply : second) {
+            for (auto& point : ply.polyline) {
+                point.x += second_shift;
+            }
+            result.push_back(std::move(ply));
+        }
+        return result;
+    };
+
+    ls::SectionCache cache;
+    const auto converted = ls::Interface::convertSketch(make_raw(0.), {}, &cache);
+    CHECK(converted.has_value() && converted->sections.size() == 2 && converted->report.reused_sections == 0);
+    if (!converted.has_value() || converted->sections.size() != 2) {
+        return;
+    }
+    const auto& sections = converted->sections;
+    CHECK(sections[0].firstColumn == 0 && sections[1].firstColumn > 0);
+    const double second_left = converted->data.getNode(converted->columns[sections[1].firstColumn].front()).point.x;
+    CHECK(std::abs(second_left + sections[1].origin.x - 100.) < 1e-9);
+
+    const auto shifted = ls::Interface::convertSketch(make_raw(20.), {}, &cache);
+    CHECK(shifted.has_value() && shifted->report.reused_sections == 2);
+
+    first.front().polyline.back().y += 0.1;
+    const auto changed = ls::Interface::convertSketch(make_raw(20.), {}, &cache);
+    CHECK(changed.has_value() && changed->report.reused_sections == 1);
+}
+
+// ---- История изменений ----
+
+// Новая версия массива разделяет с базовой неизмененные блоки, а обход изменений
+// видит только элементы измененного блока
+void TestPersistentArraySharing() {
+    using Array = PersistentArray<int, 4>;
+    const auto equal = [](int lhs, int rhs) { return lhs == rhs; };
+    auto make = [&](const std::vector<int>& values, const Array& base) {
+        auto it = values.begin();
+        return Array::build(values.size(), [&it] { return *it++; }, base, equal);
+    };
+
+    const std::vector<int> values{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    const Array first = make(values, {});
+    CHECK(first.size() == values.size());
+    CHECK(make(values, first).isSharedWith(first));
+
+    std::vector<int> changed_values = values;
+    changed_values[5] = 50;
+    const Array second = make(changed_values, first);
+    CHECK(!second.isSharedWith(first));
+
+    std::vector<size_t> changed;
+    second.forEachChanged(first, [&](size_t index, int value) {
+        changed.push_back(index);
+        CHECK(value == changed_values[index]);
+    });
+    CHECK((changed == std::vector<size_t>{ 4, 5, 6, 7 }));
+}
+
+// Отмена и повтор восстанавливают параметры, координаты узлов и габарит эскиза
+void TestUndoRedoSnapshots() {
+    RawData raw;
+    AddPlies(raw, 0, 4, 0., 40.);
+
+    ls::Interface sketch;
+    CHECK(sketch.fillSketch(std::move(raw)));
+    sketch.commit();
+    const double first_width = sketch.width();
+    const double first_end = sketch.rawSketch().front().polyline.back().x;
+    CHECK(!sketch.canUndo());
+
+    sketch.optimizeSketch(2., 10.);
+    sketch.commit();
+    const double second_width = sketch.width();
+    CHECK(second_width != first_width);
+
+    CHECK(sketch.undo());
+    CHECK(sketch.width() == first_width);
+    CHECK(sketch.rawSketch().front().polyline.back().x == first_end);
+    CHECK(sketch.params().offset == ls::Interface::DefaultOffset);
+    CHECK(sketch.canRedo() && !sketch.canUndo());
+
+    CHECK(sketch.redo());
+    CHECK(sketch.width() == second_width);
+    CHECK(sketch.params().offset == 2. && sketch.params().segment_len == 10.);
+    CHECK(!sketch.canRedo());
+}
+
+// ---- Соединение узлов слоя ----
+
+// Сегменты с общим кандидатом попадают в одну группу, в том числе через цепочку общих кандидатов
+void TestGroupConflictingPlies() {
+    const std::vector<std::vector<size_t>> candidates{ { 0, 1 }, { 2 }, { 1, 3 }, {}, { 3, 4 }, { 5 } };
+    const auto groups = GroupConflictingPlies(candidates, 6);
+
+    const std::vector<std::vector<size_t>> expected{ { 0, 2, 4 }, { 1 }, { 3 }, { 5 } };
+    CHECK(groups == expected);
+    CHECK(GroupConflictingPlies({}, 0).empty());
+}
+
+// ---- Данные исходных слоев ----
+
+// Совпадающие записи получают один номер, записи восстанавливаются по номеру,
+// а номера ломаных переходят в слои преобразованного эскиза и в записываемый эскиз
+void TestPlyMetaInterning() {
+    PlyMetaTable table;
+    const PlyMeta first{ .layer = "PLIES", .material = "CF", .ply_id = "P1", .handle = "1A" };
+    const PlyMeta second{ .layer = "PLIES", .material = "CF", .ply_id = "P2", .handle = "1B" };
+
+    const PlyMetaId first_id = table.intern(first);
+    const PlyMetaId second_id = table.intern(second);
+    CHECK(first_id != NoPlyMeta && second_id != NoPlyMeta && first_id != second_id);
+    CHECK(table.intern(first) == first_id);
+    CHECK(table.size() == 2);
+    CHECK(table.get(first_id) == first && table.get(second_id) == second);
+    CHECK(table.layer(second_id) == "PLIES");
+    CHECK(table.get(NoPlyMeta) == PlyMeta{} && table.layer(second_id + 1).empty());
+
+    RawData raw;
+    AddPlies(raw, 0, 1, 0., 40.);
+    raw.front().meta = first_id;
+    raw.back().meta = second_id;
+
+    ls::Interface sketch;
+    CHECK(sketch.fillSketch(std::move(raw)));
+    std::vector<PlyMetaId> ids;
+    for (const auto& ply : sketch.rawSketch()) {
+        ids.push_back(ply.meta);
+    }
+    std::sort(ids.begin(), ids.end());
+    CHECK((ids == std::vector<PlyMetaId>{ first_id, second_id }));
+}
+
+// ---- Заполнители ----
+
+// Заполнитель между двумя пакетами слоев при сильном сжатии сохраняет ширину не меньше своей высоты
+void TestCoreKeepsWidthUnderCompression() {
+    RawData raw;
+    AddPlies(raw, 0, 4, 0., 40.);       // Пакет под заполнителем, верхний слой на y = 1
+    AddPlies(raw, 14, 16, 0., 40.);     // Пакет над заполнителем, нижний слой на y = 3.5
+    raw.push_back(MakePolyline({ { 5., 1.25 }, { 15., 1.25 }, { 15., 3.25 }, { 5., 3.25 }, { 5., 1.25 } }));
+
+    ls::Interface sketch;
+    CHECK(sketch.fillSketch(std::move(raw)));
+    // Без заполнителя колонки с шагом 5 мм сблизились бы до 0.25 мм, и ширина заполнителя
+    // стала бы вчетверо меньше его высоты
+    sketch.optimizeSketch(1., 1.);
+
+    const auto cores = sketch.cores();
+    CHECK(cores.size() == 1);
+    if (cores.size() != 1) {
+        return;
+    }
+    BoundingBox box;
+    for (const auto& point : cores.front().points()) {
+        box.extend(point);
+    }
+    CHECK(box.height() > 0.);
+    CHECK(box.width() >= 0.9 * box.height());
+}
+
+// ---- Профиль толщины ----
+
+// Положения станций совпадают с положениями колонок в исходном файле для каждого сечения
+void TestProfileInSourceCoordinates() {
+    RawData raw;
+    AddPlies(raw, 0, 4, 20., 60.);
+    AddPlies(raw, 8, 11, 120., 160.);   // Второе сечение выше и правее первого
+
+    ls::Interface sketch;
+    CHECK(sketch.fillSketch(std::move(raw)));
+    const auto& profile = sketch.thicknessProfile();
+    CHECK(!profile.empty());
+
+    for (const auto& station : profile) {
+        const double left = (station.section == 0) ? 20. : 120.;
+        const double offset = (station.x - left) / 5.;
+        CHECK(station.x >= left - 1e-9 && station.x <= left + 40. + 1e-9);
+        CHECK(std::abs(offset - std::round(offset)) < 1e-9);
+    }
+    CHECK(profile.front().section == 0 && std::abs(profile.front().x - 20.) < 1e-9);
+    CHECK(profile.back().section == 1 && std::abs(profile.back().x - 160.) < 1e-9);
+}
+
+// ---- Подбор параметров ----
+
+// Подобранные параметры лежат в пределах, а эскиз помещается в лист. Недопустимые пределы отклоняются
+void TestAutoFitLimits() {
+    RawData raw;
+    AddPlies(raw, 0, 4, 0., 40.);
+    ls::Interface sketch;
+    CHECK(sketch.fillSketch(std::move(raw)));
+
+    const ls::ParamsLimits limits{ .min_offset = 0.5, .max_offset = 3., .min_segment_len = 2., .max_segment_len = 20. };
+    const auto fit = sketch.autoFit(200., 100., limits);
+    CHECK(fit.has_value());
+    if (fit.has_value()) {
+        CHECK(fit->params.offset >= limits.min_offset - 1e-9 && fit->params.offset <= limits.max_offset + 1e-9);
+        CHECK(fit->params.segment_len >= limits.min_segment_len - 1e-9
+              && fit->params.segment_len <= limits.max_segment_len + 1e-9);
+        CHECK(fit->width <= 200. + 1e-6 && fit->height <= 100. + 1e-6);
+    }
+
+    CHECK(!sketch.autoFit(0., 100., limits).has_value());
+    CHECK(!sketch.autoFit(200., 100., { .min_offset = 0., .max_offset = 3., .min_segment_len = 2., .max_segment_len = 20. }));
+    CHECK(!sketch.autoFit(200., 100., { .min_offset = 3., .max_offset = 1., .min_segment_len = 2., .max_segment_len = 20. }));
+    CHECK(!sketch.autoFit(200., 100., { .min_offset = 0.5, .max_offset = 3., .min_segment_len = 20., .max_segment_len = 2. }));
+}
+
+// ---- Синтетические эскизы ----
+
+// Эскиз определяется только зерном: направления укладки, направления обхода и обрывы слоев
+// закреплены для зерна 7 и совпадают в любой стандартной библиотеке
+void TestSynthReproducible() {
+    const LaminateSpec spec{ .plies_count = 12, .seed = 7, .length = 100. };
+    const RawData raw = GenerateLaminate(spec);
+    CHECK(raw.size() == spec.plies_count);
+
+    std::string orientations;
+    std::string directions;
+    for (const auto& ply : raw) {
+        orientations += (ply.orientation == Orientation::Zero) ? '0'
+                        : (ply.orientation == Orientation::Perpendicular) ? '9' : 'x';
+        directions += (ply.polyline.front().x > ply.polyline.back().x) ? 'r' : 'f';
+    }
+    CHECK(orientations == "xx000x09x0xx");
+    CHECK(directions == "frrfffrfrfrf");
+    // Второй слой обрывается на 5/7 краевой зоны длиной 30 мм слева и на 4/7 справа
+    if (raw.size() < 2) {
+        return;
+    }
+    const Polyline& second = std::next(raw.begin())->polyline;
+    CHECK(std::abs(second.back().x - 150. / 7.) < 1e-9);
+    CHECK(std::abs(second.front().x - (100. - 120. / 7.)) < 1e-9);
+}
+
+// ---- Сравнение редакций ----
+
+// Слой, добавленный ниже и левее прежнего габарита, смещает начало координат эскиза и его сечение,
+// но остальные слои не считаются измененными
+void TestDiffPlyAddedBelow() {
+    RawData before_raw;
+    AddPlies(before_raw, 0, 4, 0., 40.);
+    AddPlies(before_raw, 0, 3, 100., 140.);    // Второе сечение не изменяется
+
+    RawData after_raw = before_raw;
+    AddPlies(after_raw, -1, -1, -5., 45.);
+
+    auto before = ls::Interface::convertSketch(std::move(before_raw));
+    auto after = ls::Interface::convertSketch(std::move(after_raw));
+    CHECK(before.has_value() && !before->report.isPartial() && before->sections.size() == 2);
+    CHECK(after.has_value() && !after->report.isPartial() && after->sections.size() == 2);
+    if (!before.has_value() || !after.has_value()) {
+        return;
+    }
+
+    ls::Interface sketch;
+    CHECK(sketch.setConverted(std::move(*after)));
+    const auto diff = sketch.diffWith(*before);
+
+    CHECK(diff.size() == 1);
+    CHECK(!diff.empty() && diff.front().kind == PlyChangeKind::Added);
+}
+
+// Одиночный слой не задает расстояния между слоями. Радиус поиска остается конечным,
+// поэтому слой, сместившийся дальше габарита эскиза, считается удаленным и добавленным
+void TestDiffSinglePlyMovedFar() {
+    RawData before_raw;
+    AddPlies(before_raw, 0, 0, 0., 40.);
+    RawData after_raw;
+    AddPlies(after_raw, 200, 200, 0., 40.);    // Тот же слой на 50 мм выше
+
+    auto before = ls::Interface::convertSketch(std::move(before_raw));
+    auto after = ls::Interface::convertSketch(std::move(after_raw));
+    CHECK(before.has_value() && after.has_value());
+    if (!before.has_value() || !after.has_value()) {
+        return;
+    }
+
+    ls::Interface sketch;
+    CHECK(sketch.setConverted(std::move(*after)));
+    const auto diff = sketch.diffWith(*before);
+
+    CHECK(diff.size() == 2);
+    CHECK(std::ranges::none_of(diff, [](const auto& change) { return change.kind == PlyChangeKind::Modified; }));
+}
+
+// ---- Публикация преобразованного эскиза ----
+
+// Эскиз, опубликованный без оптимизации, не оставляет оптимизированных данных прежнего эскиза,
+// а опубликованный вместе с оптимизацией сразу готов к отображению
+void TestPublishConvertedWithOptimized() {
+    RawData small_raw;
+    AddPlies(small_raw, 0, 1, 0., 40.);
+    RawData large_raw;
+    AddPlies(large_raw, 0, 4, 0., 40.);
+
+    ls::Interface sketch;
+    CHECK(sketch.fillSketch(std::move(small_raw)));
+    CHECK(sketch.width() > 0.);
+
+    auto converted = ls::Interface::convertSketch(std::move(large_raw));
+    CHECK(converted.has_value() && !converted->data.isEmpty());
+    if (!converted.has_value()) {
+        return;
+    }
+    auto optimized = ls::Interface::optimizeConverted(*converted, ls::Interface::DefaultOffset,
+                                                      ls::Interface::DefaultSegLen);
+    CHECK(optimized.has_value());
+    if (!optimized.has_value()) {
+        return;
+    }
+    const double width = optimized->width;
+
+    ls::Interface unoptimized;
+    CHECK(unoptimized.fillSketch(RawData(sketch.rawSketch())));
+    CHECK(unoptimized.setConverted(ls::ConvertedSketch(*converted)));
+    CHECK(unoptimized.sketchLayers().empty() && unoptimized.width() == 0.);
+    CHECK(unoptimized.cores().empty() && unoptimized.plyLabels(1.).empty());
+
+    CHECK(sketch.setConverted(std::move(*converted), std::move(*optimized)));
+    CHECK(sketch.sketchLayers().size() == sketch.origSketchLayers().size());
+    CHECK(sketch.width() == width);
+}
+
+std::vector<Test> MakeTests() {
+    return {
+        { "cleanup/touching plies stay separate", TestTouchingPliesStaySeparate },
+        { "cleanup/weld cluster within tolerance", TestWeldClusterWithinTolerance },
+        { "convert/partial report", TestPartialConversionReport },
+        { "sections/merged and reused", TestSectionsMergedAndReused },
+        { "history/persistent array sharing", TestPersistentArraySharing },
+        { "history/undo redo snapshots", TestUndoRedoSnapshots },
+        { "link/conflicting plies grouped", TestGroupConflictingPlies },
+        { "meta/interning", TestPlyMetaInterning },
+        { "cores/width kept under compression", TestCoreKeepsWidthUnderCompression },
+        { "profile/stations in source coordinates", TestProfileInSourceCoordinates },
+        { "fit/limits", TestAutoFitLimits },
+        { "synth/reproducible from seed", TestSynthReproducible },
+        { "diff/ply added below", TestDiffPlyAddedBelow },
+        { "diff/single ply moved far", TestDiffSinglePlyMovedFar },
+        { "iface/publish converted with optimized", TestPublishConvertedWithOptimized },
+    };
+}
+
+} // namespace
+
+// Аргумент - подстрока имени проверки, без аргумента выполняются все проверки
+int main(int argc, char* argv[]) {
+    const std::string filter = (argc > 1) ? argv[1] : "";
+
+    size_t failed = 0;
+    for (const auto& test : MakeTests()) {
+        if (test.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        const size_t before = failures_count;
+        test.run();
+        const bool passed = failures_count == before;
+        std::cout << (passed ? "ok   " : "FAIL ") << test.name << std::endl;
+        failed += passed ? 0 : 1;
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
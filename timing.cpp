@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <utility>
+
+#include "timing.h"
+
+namespace domain {
+
+namespace {
+
+TimingContext& ThreadTimingContext() {
+    thread_local TimingContext context;
+    return context;
+}
+
+} // namespace
+
+TimingReport::Entry TimingReport::open(std::string_view stage) {
+    std::lock_guard lock(mutex_);
+    const auto [it, is_new] = index_.try_emplace(std::string(stage), stages_.size());
+    if (is_new) {
+        stages_.push_back(StageTime{ .stage = it->first });
+    }
+    return { .index = it->second, .session = session_ };
+}
+
+void TimingReport::add(Entry entry, double seconds, const MemoryUsage& memory) {
+    std::lock_guard lock(mutex_);
+    // Отчет мог быть очищен, пока этап выполнялся: номер относится к прежнему сеансу
+    if (entry.session != session_) {
+        return;
+    }
+    StageTime& stage = stages_[entry.index];
+    stage.seconds += seconds;
+    ++stage.calls;
+    stage.memory.add(memory);
+}
+
+std::vector<StageTime> TimingReport::stages() const {
+    std::lock_guard lock(mutex_);
+    return stages_;
+}
+
+bool TimingReport::isEmpty() const {
+    std::lock_guard lock(mutex_);
+    return stages_.empty();
+}
+
+void TimingReport::clear() {
+    std::lock_guard lock(mutex_);
+    ++session_;
+    stages_.clear();
+    index_.clear();
+}
+
+const TimingContext& CurrentTimingContext() {
+    return ThreadTimingContext();
+}
+
+TimingScope::TimingScope(TimingReport* report, TraceRecorder* trace)
+    : previous_(std::exchange(ThreadTimingContext(), TimingContext{ .report = report, .trace = trace }))
+{
+}
+
+TimingScope::TimingScope(const TimingContext& context)
+    : previous_(std::exchange(ThreadTimingContext(), context))
+{
+}
+
+TimingScope::~TimingScope() {
+    ThreadTimingContext() = std::move(previous_);
+}
+
+StageTimer::StageTimer(std::string_view name) {
+    start(name, nullptr);
+}
+
+StageTimer::StageTimer(std::string_view name, size_t index) {
+    start(name, &index);
+}
+
+void StageTimer::start(std::string_view name, const size_t* index) {
+    TimingContext& context = ThreadTimingContext();
+    if (context.trace != nullptr && context.trace->isRecording()) {
+        trace_ = context.trace;
+    }
+    if (context.report == nullptr && trace_ == nullptr) {
+        return;
+    }
+    report_ = context.report;
+    parent_length_ = context.path.size();
+    if (!context.path.empty()) {
+        context.path += '/';
+    }
+    name_offset_ = context.path.size();
+    context.path += name;
+    if (index != nullptr) {
+        context.path += ' ';
+        context.path += std::to_string(*index);
+    }
+    if (report_ != nullptr) {
+        stage_ = report_->open(context.path);
+        if constexpr (MemoryStatsEnabled) {
+            memory_.emplace();
+        }
+    }
+    start_ = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer() {
+    if (report_ == nullptr && trace_ == nullptr) {
+        return;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    TimingContext& context = ThreadTimingContext();
+    if (report_ != nullptr) {
+        report_->add(stage_, std::chrono::duration<double>(end - start_).count(),
+                     memory_ ? memory_->finish() : MemoryUsage{});
+    }
+    if (trace_ != nullptr) {
+        trace_->record(std::string_view(context.path).substr(name_offset_), start_, end);
+    }
+    context.path.resize(parent_length_);
+}
+
+void WriteJsonString(std::string_view text, std::ostream& out) {
+    out << '"';
+    for (const char c : text) {
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\r': out << "\\r"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+                out << code;
+            }
+            else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+void WriteMemoryUsageJson(const MemoryUsage& memory, std::ostream& out) {
+    out << "\"allocations\": " << memory.allocations << ", \"allocated_bytes\": " << memory.allocated_bytes
+        << ", \"retained_bytes\": " << memory.retained_bytes << ", \"live_bytes\": " << memory.live_bytes
+        << ", \"peak_bytes\": " << memory.peak_bytes;
+}
+
+void WriteTimingsJson(const std::vector<StageTime>& stages, std::ostream& out) {
+    const auto precision = out.precision(6);
+    out << '[';
+    for (size_t i = 0; i < stages.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << "{\"stage\": ";
+        WriteJsonString(stages[i].stage, out);
+        out << ", \"seconds\": " << stages[i].seconds << ", \"calls\": " << stages[i].calls;
+        if (MemoryStatsAvailable()) {
+            out << ", ";
+            WriteMemoryUsageJson(stages[i].memory, out);
+        }
+        out << '}';
+    }
+    out << ']';
+    out.precision(precision);
+}
+
+} // namespace domain
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "memory_stats.h"
+#include "trace.h"
+
+namespace domain {
+
+// Суммарное время этапа обработки
+struct StageTime {
+    std::string stage;      // Путь этапа от внешнего к вложенному через '/', например "convert/peel round 3/link"
+    double seconds = 0.;
+    size_t calls = 0;
+    MemoryUsage memory;     // Заполняется в сборке с учетом памяти (см. memory_stats.h)
+};
+
+// Отчет о времени этапов. Может заполняться из нескольких потоков.
+// Этапы перечисляются в порядке первого начала, поэтому внешний этап предшествует вложенным.
+// Время этапов внутри параллельных участков суммируется по потокам и может превышать
+// время охватывающего этапа
+class TimingReport {
+public:
+    // Этап в отчете: номер и сеанс отчета, в котором этап зарегистрирован
+    struct Entry {
+        size_t index = 0;
+        size_t session = 0;
+    };
+
+    // Регистрирует этап и возвращает его запись в отчете
+    Entry open(std::string_view stage);
+    // Добавляет к этапу 'entry' один вызов длительностью 'seconds'. Этапы, открытые
+    // до очистки отчета, не добавляются
+    void add(Entry entry, double seconds, const MemoryUsage& memory = {});
+
+    std::vector<StageTime> stages() const;
+    bool isEmpty() const;
+    // Удаляет этапы и начинает новый сеанс. Может вызываться во время выполнения этапов
+    // в других потоках: их время не попадет в новый сеанс
+    void clear();
+
+private:
+    mutable std::mutex mutex_;
+    size_t session_ = 0;
+    std::vector<StageTime> stages_;
+    std::unordered_map<std::string, size_t> index_;
+};
+
+// Замер времени в потоке: отчет, в который записываются этапы, и путь текущего этапа
+struct TimingContext {
+    TimingReport* report = nullptr;     // nullptr - замер выключен
+    TraceRecorder* trace = nullptr;     // Запись этапов на шкале времени, nullptr - без записи
+    std::string path;
+};
+
+// Контекст замера текущего потока
+const TimingContext& CurrentTimingContext();
+
+// Устанавливает контекст замера текущего потока на время своего существования.
+// Вложенные контексты перекрывают внешние, например отчет отдельного файла при пакетной обработке
+class TimingScope {
+public:
+    explicit TimingScope(TimingReport* report, TraceRecorder* trace = nullptr);
+    // Продолжает замер другого потока, например в задачах ParallelFor
+    explicit TimingScope(const TimingContext& context);
+    ~TimingScope();
+
+    TimingScope(const TimingScope&) = delete;
+    TimingScope& operator=(const TimingScope&) = delete;
+
+private:
+    TimingContext previous_;
+};
+
+// Замеряет время от создания до разрушения и записывает его в отчет контекста потока
+// как этап 'name', вложенный в текущий, а при включенной записи - также в TraceRecorder.
+// Без отчета и записи ничего не делает
+class StageTimer {
+public:
+    explicit StageTimer(std::string_view name);
+    // Этап с номером, например очередной круг цикла: "name index"
+    StageTimer(std::string_view name, size_t index);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    void start(std::string_view name, const size_t* index);
+
+    TimingReport* report_ = nullptr;
+    TraceRecorder* trace_ = nullptr;
+    TimingReport::Entry stage_;
+    size_t parent_length_ = 0;          // Длина пути внешнего этапа
+    size_t name_offset_ = 0;            // Начало имени этапа в пути
+    std::chrono::steady_clock::time_point start_;
+    std::optional<MemoryWindow> memory_;
+};
+
+// Записывает строку в кавычках JSON с экранированием специальных символов
+void WriteJsonString(std::string_view text, std::ostream& out);
+
+// Записывает поля расхода памяти объекта JSON без фигурных скобок: "allocations": ..., "peak_bytes": ...
+void WriteMemoryUsageJson(const MemoryUsage& memory, std::ostream& out);
+
+// Записывает этапы массивом JSON: [{"stage": ..., "seconds": ..., "calls": ...}, ...].
+// При учете памяти у этапов также есть поля WriteMemoryUsageJson
+void WriteTimingsJson(const std::vector<StageTime>& stages, std::ostream& out);
+
+} // namespace domain
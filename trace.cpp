@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "timing.h"
+#include "trace.h"
+
+namespace domain {
+
+void TraceRecorder::start() {
+    std::lock_guard lock(mutex_);
+    events_.clear();
+    thread_indices_.clear();
+    threads_.clear();
+    origin_ = Clock::now();
+    is_recording_.store(true, std::memory_order_relaxed);
+}
+
+void TraceRecorder::stop() {
+    is_recording_.store(false, std::memory_order_relaxed);
+}
+
+void TraceRecorder::record(std::string_view name, Clock::time_point start, Clock::time_point end) {
+    if (!isRecording()) {
+        return;
+    }
+    std::lock_guard lock(mutex_);
+    // Этап мог начаться до начала записи
+    start = std::max(start, origin_);
+    if (end < start) {
+        return;
+    }
+    events_.push_back(TraceEvent{
+        .name = std::string(name),
+        .thread = threadIndex(),
+        .start = start - origin_,
+        .duration = end - start
+    });
+}
+
+void TraceRecorder::setThreadName(std::string_view name) {
+    std::lock_guard lock(mutex_);
+    thread_names_[std::this_thread::get_id()] = name;
+}
+
+std::vector<TraceEvent> TraceRecorder::events() const {
+    std::lock_guard lock(mutex_);
+    return events_;
+}
+
+bool TraceRecorder::isEmpty() const {
+    std::lock_guard lock(mutex_);
+    return events_.empty();
+}
+
+size_t TraceRecorder::threadIndex() {
+    const auto [it, is_new] = thread_indices_.try_emplace(std::this_thread::get_id(), threads_.size());
+    if (is_new) {
+        threads_.push_back(it->first);
+    }
+    return it->second;
+}
+
+void TraceRecorder::writeChromeTrace(std::ostream& out) const {
+    std::lock_guard lock(mutex_);
+
+    // Время в микросекундах с дробной частью
+    const auto microseconds = [](std::chrono::nanoseconds time) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", static_cast<double>(time.count()) / 1000.);
+        return std::string(text);
+    };
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    // Имена только потоков с событиями этого сеанса
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        const auto name = thread_names_.find(threads_[i]);
+        out << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << i << ", \"args\": {\"name\": ";
+        WriteJsonString(name != thread_names_.end() ? name->second : "thread " + std::to_string(i), out);
+        out << "}}" << (i + 1 < threads_.size() || !events_.empty() ? "," : "") << '\n';
+    }
+    for (size_t i = 0; i < events_.size(); ++i) {
+        const auto& event = events_[i];
+        out << "  {\"name\": ";
+        WriteJsonString(event.name, out);
+        out << ", \"cat\": \"stage\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+            << ", \"ts\": " << microseconds(event.start) << ", \"dur\": " << microseconds(event.duration) << '}'
+            << (i + 1 < events_.size() ? "," : "") << '\n';
+    }
+    out << "]}\n";
+}
+
+} // namespace domain
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace domain {
+
+// Интервал выполнения этапа на шкале времени
+struct TraceEvent {
+    std::string name;
+    size_t thread = 0;                  // Номер потока в порядке первого события сеанса записи
+    std::chrono::nanoseconds start{};   // От начала записи
+    std::chrono::nanoseconds duration{};
+};
+
+// Запись этапов на шкале времени по потокам. В отличие от TimingReport интервалы не суммируются,
+// поэтому видны отдельные долгие вызовы, например перерисовка во время оптимизации.
+// Может заполняться из нескольких потоков. StageTimer записывает этапы, если запись включена
+class TraceRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Удаляет записанные события и начинает запись, отсчет времени - с момента вызова
+    void start();
+    void stop();
+    bool isRecording() const { return is_recording_.load(std::memory_order_relaxed); }
+
+    // Добавляет интервал текущего потока. Без включенной записи ничего не делает
+    void record(std::string_view name, Clock::time_point start, Clock::time_point end);
+    // Имя текущего потока в записи, например "ui". Сохраняется между сеансами записи
+    void setThreadName(std::string_view name);
+
+    std::vector<TraceEvent> events() const;
+    bool isEmpty() const;
+
+    // Записывает события в формате Chrome trace event JSON для Perfetto и chrome://tracing
+    void writeChromeTrace(std::ostream& out) const;
+
+private:
+    // Номер текущего потока в сеансе записи. Вызывается под mutex_
+    size_t threadIndex();
+
+    mutable std::mutex mutex_;
+    std::atomic<bool> is_recording_{ false };
+    Clock::time_point origin_;
+    std::vector<TraceEvent> events_;
+    // Потоки с событиями текущего сеанса. ParallelFor создает новые потоки при каждом вызове,
+    // поэтому таблица очищается в start()
+    std::unordered_map<std::thread::id, size_t> thread_indices_;
+    std::vector<std::thread::id> threads_;
+    // Имена задаются только долгоживущим потокам и сохраняются между сеансами
+    std::unordered_map<std::thread::id, std::string> thread_names_;
+};
+
+} // namespace domain